@@ -0,0 +1,332 @@
+// Micro-benchmarks for the hash kernels used by the hasher. Every path
+// through MAW32 and SHA-256 is timed over a grid of round counts, message
+// lengths and thread counts, and one CSV row is printed per combination so
+// that runs on different commits can be compared directly
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <x86intrin.h>
+
+#include "../hash/sha2.h"
+#include "../hash/maw32.h"
+#include "../hash/algo.h"
+#include "../hash/algos.h"
+#include "../hash/threads.h"
+#include "../hash/channel.h"
+#include "../hash/prng.h"
+
+// Ways of hashing a message which are timed
+enum bench_path
+{
+    PATH_HEX,       // algo->hash, producing a hex string
+    PATH_RAW,       // algo->hash_raw, one message at a time
+    PATH_STREAM,    // init, update in pieces, then final
+    PATH_MANY,      // algo->hash_many over a whole batch
+    PATH_SHARED,    // algo->hash_many_shared, with every whole block shared
+    PATH_SWEEP,     // algo->hash_sweep, giving every round count at once
+    NUM_PATHS
+};
+static const char *path_names[NUM_PATHS] = { "hex", "raw", "stream", "many", "shared", "sweep" };
+
+// Size of the pieces fed to update by the stream path; odd, so that updates
+// straddle block boundaries and the partial block buffer is exercised
+#define BENCH_STREAM_CHUNK 61
+
+// Most values which may be given in a list
+#define BENCH_MAX_LIST 256
+
+// One combination of the grid being timed
+struct bench_case
+{
+    const struct hash_algo *algo;
+    enum bench_path path;
+    uint32_t rounds;
+    uint32_t len;
+    double seconds;                 // How long every worker keeps hashing for
+    pthread_barrier_t start;        // Lines the workers up once they have warmed up
+};
+
+// State owned by a single worker
+struct bench_worker
+{
+    pthread_t tid;
+    struct bench_case *bc;
+    uint64_t seed;
+    uint64_t hashes;                // How many messages were hashed
+    uint64_t cycles;                // Time-stamp counter ticks spent hashing them
+    double seconds;                 // Wall time spent hashing them
+    char pad[CACHE_LINE];
+};
+
+// Hash every one of the n messages in msgs once, along the path being timed
+static void bench_batch(const struct bench_case *bc, const uint8_t *msgs, size_t n, uint8_t *out, void *ctx)
+{
+    const struct hash_algo *algo = bc->algo;
+    const size_t len = bc->len, dig = algo->dig_size;
+    char hashbuf[2*MAX_BLOCK_SIZE + 1];
+    switch (bc->path)
+    {
+    case PATH_HEX:
+        for (size_t idx = 0; idx < n; idx++) algo->hash(msgs + idx * len, len, bc->rounds, hashbuf);
+        break;
+    case PATH_RAW:
+        for (size_t idx = 0; idx < n; idx++) algo->hash_raw(msgs + idx * len, len, bc->rounds, out + idx * dig);
+        break;
+    case PATH_STREAM:
+        for (size_t idx = 0; idx < n; idx++)
+        {
+            const uint8_t *msg = msgs + idx * len;
+            algo->init(ctx, bc->rounds);
+            for (size_t off = 0; off < len; off += BENCH_STREAM_CHUNK)
+            {
+                algo->update(ctx, msg + off, len - off < BENCH_STREAM_CHUNK? len - off : BENCH_STREAM_CHUNK);
+            }
+            algo->final(ctx, out + idx * dig);
+        }
+        break;
+    case PATH_MANY:
+        algo->hash_many(msgs, n, len, bc->rounds, out);
+        break;
+    case PATH_SHARED:
+        algo->hash_many_shared(msgs, n, len, len / algo->blk_size, bc->rounds, out);
+        break;
+    case PATH_SWEEP:
+        // Every round count of a message lands in out, so only the last message's survive
+        for (size_t idx = 0; idx < n; idx++) algo->hash_sweep(msgs + idx * len, len, bc->rounds, NULL, out);
+        break;
+    default:
+        break;
+    }
+}
+
+// Worker thread; hashes batches of random messages until its time is up
+static void *bench_worker_main(void *arg)
+{
+    struct bench_worker *worker = (struct bench_worker *) arg;
+    struct bench_case *bc = worker->bc;
+    const struct hash_algo *algo = bc->algo;
+    const size_t len = bc->len;
+
+    // Random messages; for the shared path, every whole block is the same in all of them
+    struct prng rng;
+    prng_seed(&rng, worker->seed);
+    uint8_t *msgs = malloc((size_t) BATCH_SIZE * len + 1);
+    prng_fill(&rng, msgs, (size_t) BATCH_SIZE * len);
+    if (bc->path == PATH_SHARED)
+    {
+        size_t same = len / algo->blk_size * algo->blk_size;
+        for (size_t idx = 1; idx < BATCH_SIZE; idx++) memcpy(msgs + idx * len, msgs, same);
+    }
+    size_t out_size = BATCH_SIZE > algo->max_rounds? BATCH_SIZE : algo->max_rounds;
+    uint8_t *out = malloc(out_size * algo->dig_size);
+    void *ctx = malloc(algo->ctx_size);
+
+    // Warm up the caches and branch predictors, then start together
+    bench_batch(bc, msgs, BATCH_SIZE, out, ctx);
+    pthread_barrier_wait(&bc->start);
+
+    double begin = now_seconds(), elapsed;
+    uint64_t ticks = __rdtsc(), hashes = 0;
+    do
+    {
+        bench_batch(bc, msgs, BATCH_SIZE, out, ctx);
+        hashes += BATCH_SIZE;
+        elapsed = now_seconds() - begin;
+    }
+    while (elapsed < bc->seconds);
+    worker->cycles  = __rdtsc() - ticks;
+    worker->seconds = elapsed;
+    worker->hashes  = hashes;
+
+    free(msgs);
+    free(out);
+    free(ctx);
+    return NULL;
+}
+
+// Time one combination of the grid with nthreads workers, and print its row
+static void bench_run(struct bench_case *bc, size_t nthreads)
+{
+    const struct hash_algo *algo = bc->algo;
+    struct bench_worker *workers = calloc(nthreads, sizeof(struct bench_worker));
+    pthread_barrier_init(&bc->start, NULL, nthreads);
+    for (size_t idx = 0; idx < nthreads; idx++)
+    {
+        workers[idx].bc   = bc;
+        workers[idx].seed = 0x9e3779b97f4a7c15ULL * (idx + 1);
+        pthread_create(&workers[idx].tid, NULL, bench_worker_main, &workers[idx]);
+    }
+
+    // Every worker's rate is measured over its own run, then summed
+    uint64_t hashes = 0, cycles = 0;
+    double rate = 0;
+    for (size_t idx = 0; idx < nthreads; idx++)
+    {
+        pthread_join(workers[idx].tid, NULL);
+        hashes += workers[idx].hashes;
+        cycles += workers[idx].cycles;
+        rate   += workers[idx].hashes / workers[idx].seconds;
+    }
+    pthread_barrier_destroy(&bc->start);
+
+    const char *backend;
+    if (bc->path == PATH_MANY || bc->path == PATH_SHARED) backend = algo->many_backend? algo->many_backend() : "scalar";
+    else                                                  backend = algo->backend? algo->backend() : "scalar";
+    printf("%s,%s,%s,%u,%u,%zu,%llu,%.2f,", algo->name, backend, path_names[bc->path], bc->rounds, bc->len,
+           nthreads, (unsigned long long) hashes, 1e9 * nthreads / rate);
+    // Empty messages have no bytes to divide between
+    if (bc->len) printf("%.3f", (double) cycles / hashes / bc->len);
+    printf(",%.0f,%.0f\n", rate, rate / nthreads);
+    fflush(stdout);
+    free(workers);
+}
+
+// Parse a comma-separated list of integers and ranges such as 1,4-8 into
+// vals, which holds at most BENCH_MAX_LIST values
+static bool parse_list(const char *str, uint32_t *vals, size_t *count)
+{
+    *count = 0;
+    while (*str)
+    {
+        char *end;
+        if (*str < '0' || *str > '9') return false;
+        unsigned long lo = strtoul(str, &end, 10), hi = lo;
+        if (*end == '-')
+        {
+            if (end[1] < '0' || end[1] > '9') return false;
+            hi = strtoul(end + 1, &end, 10);
+        }
+        if (hi < lo || hi > UINT32_MAX || *count + (hi - lo) >= BENCH_MAX_LIST) return false;
+        for (unsigned long val = lo; val <= hi; val++) vals[(*count)++] = val;
+        if (*end == ',') end++;
+        else if (*end) return false;
+        str = end;
+    }
+    return *count > 0;
+}
+
+// Display how to use the benchmarks
+static void show_usage()
+{
+    puts("USAGE: hash_bench [FLAGS]\n"
+         "\n"
+         "Time the hash kernels over every combination of the lists below,\n"
+         "printing one CSV row per combination to stdout with the columns:\n"
+         "  algo, backend, path, rounds, len, threads, hashes,\n"
+         "  ns_per_hash, cycles_per_byte, hashes_per_sec, hashes_per_sec_per_thread\n"
+         "ns_per_hash is the time one thread spends on each message, and\n"
+         "cycles_per_byte counts time-stamp counter ticks per message byte;\n"
+         "it is left empty for empty messages.\n"
+         "\n"
+         "FLAGS:\n"
+         "  -a algo,...:\n"
+         "    Algorithms to time. Defaults to every algorithm.\n"
+         "  -p path,...:\n"
+         "    Paths to time. Defaults to every path:\n"
+         "      hex:    hash to a hex string, one message at a time\n"
+         "      raw:    hash to a raw digest, one message at a time\n"
+         "      stream: init, update in 61-byte pieces, then final\n"
+         "      many:   hash a batch of 1024 messages with the SIMD kernel\n"
+         "      shared: as many, with every whole block of the batch the same\n"
+         "      sweep:  digests for every round count up to rounds at once\n"
+         "  -r list:\n"
+         "    Round counts to time, e.g. 1-16,64. Counts beyond what an\n"
+         "    algorithm has are skipped. Defaults to the full rounds.\n"
+         "  -l list:\n"
+         "    Message lengths in bytes. Defaults to 3,8,16,55,64,256,1024,4096.\n"
+         "  -j list:\n"
+         "    Thread counts; 0 means one per core. Defaults to 1,0.\n"
+         "  -t seconds:\n"
+         "    How long to time each combination for. Defaults to 0.25.");
+}
+
+// Time the hash kernels over a grid of parameters
+int main(int argc, char **argv)
+{
+    // Used to ensure user-supplied data is valid
+    #define ASSERT(expr, ...)   \
+    if (!(expr))                \
+    {                           \
+        __VA_ARGS__;            \
+        show_usage();           \
+        return 1;               \
+    }
+
+    bool algos[num_known_algos], paths[NUM_PATHS];
+    for (size_t i = 0; i < num_known_algos; i++) algos[i] = true;
+    for (size_t i = 0; i < NUM_PATHS; i++) paths[i] = true;
+    uint32_t rounds[BENCH_MAX_LIST], lens[BENCH_MAX_LIST] = { 3, 8, 16, 55, 64, 256, 1024, 4096 };
+    uint32_t threads[BENCH_MAX_LIST] = { 1, 0 };
+    size_t nrounds = 0, nlens = 8, nthreads = 2;
+    double seconds = 0.25;
+
+    for (int idx = 1; idx < argc; idx++)
+    {
+        ASSERT(idx + 1 < argc, printf("Flag '%s' requires a value\n", argv[idx]));
+        char *val = argv[++idx];
+        if (!strcmp(argv[idx-1], "-a") || !strcmp(argv[idx-1], "-p"))
+        {
+            bool is_algo = argv[idx-1][1] == 'a';
+            bool *chosen = is_algo? algos : paths;
+            size_t n = is_algo? num_known_algos : NUM_PATHS;
+            memset(chosen, 0, n * sizeof(bool));
+            for (char *name = strtok(val, ","); name; name = strtok(NULL, ","))
+            {
+                size_t i;
+                for (i = 0; i < n; i++) if (!strcmp(name, is_algo? known_algos[i].name : path_names[i])) break;
+                ASSERT(i < n, printf("Unknown %s '%s'\n", is_algo? "hash function" : "path", name));
+                chosen[i] = true;
+            }
+        }
+        else if (!strcmp(argv[idx-1], "-r"))
+        {
+            ASSERT(parse_list(val, rounds, &nrounds), puts("Flag '-r' requires a list of integers"));
+        }
+        else if (!strcmp(argv[idx-1], "-l"))
+        {
+            ASSERT(parse_list(val, lens, &nlens), puts("Flag '-l' requires a list of integers"));
+        }
+        else if (!strcmp(argv[idx-1], "-j"))
+        {
+            ASSERT(parse_list(val, threads, &nthreads), puts("Flag '-j' requires a list of integers"));
+        }
+        else if (!strcmp(argv[idx-1], "-t"))
+        {
+            char *end;
+            seconds = strtod(val, &end);
+            ASSERT(!*end && seconds > 0, puts("Flag '-t' requires a positive number"));
+        }
+        else ASSERT(false, printf("Unknown flag '%s'\n", argv[idx-1]));
+    }
+    // A thread count of 0 means every core, which may repeat another count
+    for (size_t i = 0; i < nthreads; i++) if (!threads[i]) threads[i] = num_cores();
+    for (size_t i = 0; i < nthreads; i++) for (size_t k = 0; k < i; k++) if (threads[k] == threads[i])
+    {
+        memmove(threads + i, threads + i + 1, (--nthreads - i) * sizeof(uint32_t));
+        i--;
+        break;
+    }
+
+    puts("algo,backend,path,rounds,len,threads,hashes,ns_per_hash,cycles_per_byte,hashes_per_sec,hashes_per_sec_per_thread");
+    for (size_t a = 0; a < num_known_algos; a++) if (algos[a])
+    {
+        const struct hash_algo *algo = &known_algos[a];
+        uint32_t full = algo->max_rounds;
+        const uint32_t *rlist = nrounds? rounds : &full;
+        for (size_t p = 0; p < NUM_PATHS; p++) if (paths[p])
+        for (size_t r = 0; r < (nrounds? nrounds : 1); r++)
+        for (size_t l = 0; l < nlens; l++)
+        {
+            struct bench_case bc = { algo, p, rlist[r], lens[l], seconds };
+            // Skip combinations which the path cannot run
+            if (bc.rounds > algo->max_rounds) continue;
+            if (p == PATH_SHARED && bc.len < algo->blk_size) continue;
+            if (p == PATH_SWEEP && !bc.rounds) continue;
+            for (size_t j = 0; j < nthreads; j++) bench_run(&bc, threads[j]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,138 @@
+// Description of the hash algorithms known to the hasher, and helpers for
+// working with their raw digests
+
+#ifndef __ALGO
+#define __ALGO
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Description of a hash algorithm
+struct hash_algo
+{
+    char *name;         // Name (lowercase)
+    size_t blk_size;    // Block size in bytes
+    size_t dig_size;    // Digest size in bytes
+    size_t max_rounds;  // Rounds in the full compression function
+    size_t state_size;  // Size of the compression function's registers in bytes
+    char *(*hash)(const uint8_t *, size_t, size_t, char *); // Pointer to the function
+    void (*hash_raw)(const uint8_t *, size_t, size_t, uint8_t *); // Raw digest variant
+    void (*hash_many)(const uint8_t *, size_t, size_t, size_t, uint8_t *); // Batch variant; may be NULL
+    const char *(*backend)();       // Names the backend picked for hash_raw; NULL if only scalar
+    const char *(*many_backend)();  // Names the backend picked for hash_many; NULL if there is none
+    size_t (*pair_check)(const uint8_t *, const uint8_t *, size_t, const uint8_t *, const uint8_t *); // Lockstep characteristic check
+    void (*hash_sweep)(const uint8_t *, size_t, size_t, uint8_t *, uint8_t *); // Digests for every round count
+    void (*hash_many_shared)(const uint8_t *, size_t, size_t, size_t, size_t, uint8_t *); // Batch variant with a shared prefix
+    size_t ctx_size;                                        // Size of the streaming context
+    void (*init)(void *, size_t);                           // Streaming interface, taking a context
+    void (*update)(void *, const uint8_t *, size_t);        // of ctx_size bytes
+    void (*final)(void *, uint8_t *);
+};
+
+// How many inputs are generated and hashed together by sample, iterate and diff
+#define BATCH_SIZE 1024
+
+// Largest block size of any known algorithm, in bytes
+#define MAX_BLOCK_SIZE 64
+
+// 16 bytes, for hex-encoding a whole vector at once
+typedef uint8_t hex_v __attribute__((vector_size(16)));
+
+// Hex-encode len bytes of data into buf, which must hold at least 2*len+1 bytes
+static inline char *to_hex(const uint8_t *data, size_t len, char *buf)
+{
+    static const char digits[] = "0123456789abcdef";
+    size_t idx = 0;
+    // Split 16 bytes at a time into nibbles, turn each into a digit, then
+    // interleave the high and low digits back together
+    for ( ; idx + 16 <= len; idx += 16)
+    {
+        static const hex_v first = { 0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23 },
+                           second = { 8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31 };
+        hex_v x, hi, lo;
+        memcpy(&x, data + idx, 16);
+        hi = x >> 4;
+        lo = x & 0xf;
+        hi += '0' + ((hex_v)(hi > 9) & ('a' - '0' - 10));
+        lo += '0' + ((hex_v)(lo > 9) & ('a' - '0' - 10));
+        hex_v out1 = __builtin_shuffle(hi, lo, first), out2 = __builtin_shuffle(hi, lo, second);
+        memcpy(buf + 2*idx,      &out1, 16);
+        memcpy(buf + 2*idx + 16, &out2, 16);
+    }
+    for ( ; idx < len; idx++)
+    {
+        buf[2*idx]   = digits[data[idx] >> 4];
+        buf[2*idx+1] = digits[data[idx] & 0xf];
+    }
+    buf[2*len] = '\0';
+    return buf;
+}
+
+// Compare two raw digests of size bytes; digest sizes are always a multiple of 4
+static inline bool digest_equal(const uint8_t *x, const uint8_t *y, size_t size)
+{
+    for (size_t idx = 0; idx < size; idx += 4)
+    {
+        uint32_t wx, wy;
+        memcpy(&wx, x + idx, 4);
+        memcpy(&wy, y + idx, 4);
+        if (wx != wy) return false;
+    }
+    return true;
+}
+
+// Count the bits in which two raw digests of size bytes differ
+static inline uint32_t digest_distance(const uint8_t *x, const uint8_t *y, size_t size)
+{
+    uint32_t dist = 0;
+    for (size_t idx = 0; idx < size; idx += 4)
+    {
+        uint32_t wx, wy;
+        memcpy(&wx, x + idx, 4);
+        memcpy(&wy, y + idx, 4);
+        dist += __builtin_popcount(wx ^ wy);
+    }
+    return dist;
+}
+
+// Count the whole blocks at the start of every one of n messages of length
+// len which are the same as in the first message
+static inline size_t shared_blocks(const struct hash_algo *algo, const uint8_t *msgs, size_t n, size_t len)
+{
+    size_t shared = len / algo->blk_size;
+    for (size_t idx = 1; idx < n && shared; idx++)
+    {
+        const uint8_t *msg = msgs + idx * len;
+        size_t same = shared * algo->blk_size;
+        if (!memcmp(msgs, msg, same)) continue;
+        // Find where this message first differs
+        for (same = 0; msgs[same] == msg[same]; same++) ;
+        shared = same / algo->blk_size;
+    }
+    return shared;
+}
+
+// Compute the raw digests of n messages of length len, stored back-to-back in
+// msgs, using the batch variant of the algorithm where there is one. When the
+// messages begin with the same blocks, as successive inputs from iterate do,
+// those blocks are only compressed once
+static inline void hash_many(const struct hash_algo *algo, const uint8_t *msgs, size_t n, 
+                             size_t len, size_t rounds, uint8_t *out)
+{
+    size_t shared;
+    if (algo->hash_many_shared && len >= algo->blk_size && (shared = shared_blocks(algo, msgs, n, len)))
+    {
+        algo->hash_many_shared(msgs, n, len, shared, rounds, out);
+        return;
+    }
+    if (algo->hash_many)
+    {
+        algo->hash_many(msgs, n, len, rounds, out);
+        return;
+    }
+    for (size_t idx = 0; idx < n; idx++) algo->hash_raw(msgs + idx * len, len, rounds, out + idx * algo->dig_size);
+}
+
+#endif // __ALGO
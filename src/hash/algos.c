@@ -0,0 +1,16 @@
+#include "algos.h"
+#include "sha2.h"
+#include "maw32.h"
+
+const struct hash_algo known_algos[] = 
+{
+    { "maw32", 8, 4, 16, 4, maw32_hash, maw32_hash_raw, maw32_hash_many, NULL, maw32_many_backend,
+      maw32_pair_check, maw32_hash_sweep, maw32_hash_many_shared, sizeof(struct maw32_ctx),
+      (void (*)(void *, size_t)) maw32_init, (void (*)(void *, const uint8_t *, size_t)) maw32_update,
+      (void (*)(void *, uint8_t *)) maw32_final },
+    { "sha256", 64, 32, 64, 32, sha256_hash, sha256_hash_raw, sha256_hash_many, sha256_backend, sha256_many_backend,
+      sha256_pair_check, sha256_hash_sweep, sha256_hash_many_shared, sizeof(struct sha256_ctx),
+      (void (*)(void *, size_t)) sha256_init, (void (*)(void *, const uint8_t *, size_t)) sha256_update,
+      (void (*)(void *, uint8_t *)) sha256_final },
+};
+const size_t num_known_algos = sizeof(known_algos) / sizeof(known_algos[0]);
@@ -0,0 +1,14 @@
+// Table of the hash algorithms known to the hasher, shared by the hasher
+// and the benchmarks
+
+#ifndef __ALGOS
+#define __ALGOS
+
+#include <stdio.h>
+#include "algo.h"
+
+// Const array of supported hash functions, and how many entries it has
+extern const struct hash_algo known_algos[];
+extern const size_t num_known_algos;
+
+#endif // __ALGOS
@@ -0,0 +1,150 @@
+// Multithreaded measurement of the avalanche effect of a hash algorithm
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "util.h"
+#include "algo.h"
+#include "prng.h"
+#include "channel.h"
+#include "threads.h"
+#include "avalanche.h"
+
+// State owned by a single worker
+struct avalanche_worker
+{
+    pthread_t tid;
+    const struct avalanche_conf *conf;
+    uint64_t *issued;               // Shared count of base messages handed out so far
+    struct prng rng;                // This worker's PRNG stream
+    uint64_t *flips;                // How often output bit j flipped with input bit i, at i*outbits + j
+    uint64_t done_samples;          // How many base messages have been used; read by the main thread
+    int done;                       // Set once the worker has finished
+    char pad[CACHE_LINE];
+};
+
+// Worker thread; measures random base messages until the samples run out
+static void *avalanche_worker_main(void *arg)
+{
+    struct avalanche_worker *worker = (struct avalanche_worker *) arg;
+    const struct avalanche_conf *conf = worker->conf;
+    const struct hash_algo *algo = conf->algo;
+    const size_t blk = algo->blk_size, dig = algo->dig_size;
+    const size_t inbits = 8 * blk, outbits = 8 * dig;
+
+    // Message 0 of a batch is the base, and message 1 + i has input bit i flipped
+    uint8_t *msgs    = malloc((inbits + 1) * blk),
+            *digests = malloc((inbits + 1) * dig);
+    while (1)
+    {
+        if (__atomic_fetch_add(worker->issued, 1, __ATOMIC_RELAXED) >= conf->samples) break;
+
+        prng_fill(&worker->rng, msgs, blk);
+        for (size_t i = 0; i < inbits; i++)
+        {
+            uint8_t *msg = msgs + (1 + i) * blk;
+            memcpy(msg, msgs, blk);
+            msg[i / 8] ^= 0x80 >> (i % 8);
+        }
+        hash_many(algo, msgs, inbits + 1, blk, conf->rounds, digests);
+
+        for (size_t i = 0; i < inbits; i++)
+        {
+            const uint8_t *digest = digests + (1 + i) * dig;
+            uint64_t *row = worker->flips + i * outbits;
+            for (size_t pos = 0; pos < dig; pos++)
+            {
+                uint8_t delta = digest[pos] ^ digests[pos];
+                if (!delta) continue;
+                for (int k = 0; k < 8; k++) row[8 * pos + k] += (delta >> (7 - k)) & 1;
+            }
+        }
+        __atomic_fetch_add(&worker->done_samples, 1, __ATOMIC_RELAXED);
+    }
+    free(msgs);
+    free(digests);
+    __atomic_store_n(&worker->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Measure the avalanche effect, and print the flip probability matrix
+void run_avalanche(const struct avalanche_conf *conf)
+{
+    const struct hash_algo *algo = conf->algo;
+    const size_t inbits = 8 * algo->blk_size, outbits = 8 * algo->dig_size;
+
+    // Give every worker its own non-overlapping PRNG stream
+    struct prng rng;
+    prng_seed(&rng, conf->seed);
+    uint64_t issued = 0;
+    struct avalanche_worker *workers = calloc(conf->nthreads, sizeof(struct avalanche_worker));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        workers[idx].conf   = conf;
+        workers[idx].issued = &issued;
+        workers[idx].rng    = rng;
+        workers[idx].flips  = calloc(inbits * outbits, sizeof(uint64_t));
+        prng_jump(&rng);
+        pthread_create(&workers[idx].tid, NULL, avalanche_worker_main, &workers[idx]);
+    }
+
+    // Report progress until everybody has finished
+    uint64_t last_samples = 0;
+    double last = now_seconds();
+    while (1)
+    {
+        size_t finished = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++)
+            finished += __atomic_load_n(&workers[idx].done, __ATOMIC_ACQUIRE);
+        if (finished == conf->nthreads) break;
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            uint64_t samples = 0;
+            for (size_t idx = 0; idx < conf->nthreads; idx++)
+                samples += __atomic_load_n(&workers[idx].done_samples, __ATOMIC_RELAXED);
+            log_line(stderr, "%llu/%llu base messages (%.3e/s)", (unsigned long long) samples,
+                     (unsigned long long) conf->samples, (samples - last_samples) / (now - last));
+            last_samples = samples;
+            last = now;
+        }
+        sleep_ms(10);
+    }
+
+    // Merge every worker's counts into the first
+    uint64_t *flips = workers[0].flips, samples = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_join(workers[idx].tid, NULL);
+        samples += workers[idx].done_samples;
+        if (idx) for (size_t i = 0; i < inbits * outbits; i++) flips[i] += workers[idx].flips[i];
+    }
+
+    // The matrix, then how far it is from every entry being 1/2
+    printf("Samples: %llu\n", (unsigned long long) samples);
+    double total = 0.0, worst = 0.0;
+    size_t worst_in = 0, worst_out = 0;
+    for (size_t i = 0; i < inbits; i++)
+    {
+        printf("%3zu:", i);
+        for (size_t j = 0; j < outbits; j++)
+        {
+            double p = samples? (double) flips[i * outbits + j] / samples : 0.0;
+            printf(" %.4f", p);
+            total += p;
+            if (fabs(p - 0.5) > worst) { worst = fabs(p - 0.5); worst_in = i; worst_out = j; }
+        }
+        printf("\n");
+    }
+    printf("Mean flip probability: %.5f\n", total / (inbits * outbits));
+    printf("Max |p - 1/2|: %.5f at input bit %zu, output bit %zu (expected deviation %.5f)\n",
+           worst, worst_in, worst_out, samples? 0.5 / sqrt((double) samples) : 0.0);
+    fflush(stdout);
+
+    for (size_t idx = 0; idx < conf->nthreads; idx++) free(workers[idx].flips);
+    free(workers);
+}
@@ -0,0 +1,31 @@
+// Multithreaded measurement of the avalanche effect of a hash algorithm
+
+#ifndef __AVALANCHE
+#define __AVALANCHE
+
+#include <stdint.h>
+#include "algo.h"
+
+// Configuration of an avalanche run
+struct avalanche_conf
+{
+    const struct hash_algo *algo;   // Algorithm being measured
+    size_t rounds;                  // How many rounds of the algorithm to run
+    uint64_t samples;               // How many base messages to sample
+    size_t nthreads;                // How many worker threads to run
+    uint64_t seed;                  // Seed for the workers' PRNG streams
+};
+
+// Build the input-bit by output-bit flip probability matrix for single-block
+// messages. For every random base message, the base and all of its single-bit
+// flips are hashed together as one batch, and each output bit which differs
+// from the base digest is counted against the flipped input bit. Workers keep
+// their own counts, which are merged at the end. The matrix is printed to
+// stdout one input bit per line, with bits numbered from the most significant
+// bit of the first byte, followed by a summary of how far it strays from the
+// strict avalanche criterion (every probability being 1/2).
+// Params:
+// - conf: Configuration of the run
+void run_avalanche(const struct avalanche_conf *conf);
+
+#endif // __AVALANCHE
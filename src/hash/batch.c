@@ -0,0 +1,272 @@
+// Pipeline for hashing a stream of messages read from stdin
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "algo.h"
+#include "channel.h"
+#include "threads.h"
+#include "batch.h"
+
+// A batch of messages, passed from the reader to a worker, then to the writer
+struct msg_batch
+{
+    uint64_t seq;                   // Which batch of the stream this is
+    size_t count;                   // How many messages there are
+    uint8_t *data;                  // Every message, back-to-back
+    size_t data_len, data_cap;      // Bytes of data in use, and allocated
+    size_t *offs;                   // Where each message starts in data
+    uint32_t *lens;                 // Length of each message
+    uint8_t *out;                   // Formatted digests, filled in by a worker
+    size_t out_len;
+};
+
+// State shared by every stage
+struct batch_state
+{
+    const struct batch_conf *conf;
+    struct channel *todo;           // Batches waiting for a worker
+    struct channel *done;           // Hashed batches, in whatever order they finish
+    uint64_t window;                // How far ahead of the writer workers may run
+    char pad0[CACHE_LINE];
+    uint64_t nbatches;              // How many batches were read; valid once reading is set
+    int reading;                    // Cleared by the reader at the end of stdin
+    char pad1[CACHE_LINE];
+    uint64_t written;               // How many batches the writer has written out
+    char pad2[CACHE_LINE];
+};
+
+// A message's length and position in its batch, for grouping by length
+struct msg_ref
+{
+    uint32_t len;
+    uint32_t idx;
+};
+
+static int cmp_msg_ref(const void *x, const void *y)
+{
+    const struct msg_ref *a = x, *b = y;
+    if (a->len != b->len) return (a->len > b->len) - (a->len < b->len);
+    return (a->idx > b->idx) - (a->idx < b->idx);
+}
+
+// Start a new, empty batch
+static struct msg_batch *batch_new(uint64_t seq)
+{
+    struct msg_batch *batch = calloc(1, sizeof(struct msg_batch));
+    batch->seq      = seq;
+    batch->data_cap = BATCH_BYTES;
+    batch->data     = malloc(batch->data_cap);
+    batch->offs     = malloc(BATCH_SIZE * sizeof(size_t));
+    batch->lens     = malloc(BATCH_SIZE * sizeof(uint32_t));
+    return batch;
+}
+
+static void batch_free(struct msg_batch *batch)
+{
+    free(batch->data);
+    free(batch->offs);
+    free(batch->lens);
+    free(batch->out);
+    free(batch);
+}
+
+// Add a message to a batch
+static void batch_add(struct msg_batch *batch, const uint8_t *msg, size_t len)
+{
+    if (batch->data_len + len > batch->data_cap)
+    {
+        while (batch->data_len + len > batch->data_cap) batch->data_cap *= 2;
+        batch->data = realloc(batch->data, batch->data_cap);
+    }
+    memcpy(batch->data + batch->data_len, msg, len);
+    batch->offs[batch->count] = batch->data_len;
+    batch->lens[batch->count] = len;
+    batch->data_len += len;
+    batch->count++;
+}
+
+// Hand a batch to the workers, waiting while they are all busy
+static void send_batch(struct channel *chan, struct msg_batch *batch)
+{
+    while (!channel_try_push(chan, &batch)) sleep_ms(1);
+}
+
+// Reader thread; splits stdin into batches
+static void *batch_reader_main(void *arg)
+{
+    struct batch_state *state = (struct batch_state *) arg;
+    const struct batch_conf *conf = state->conf;
+    static char inbuf[BATCH_BYTES];
+    setvbuf(stdin, inbuf, _IOFBF, sizeof(inbuf));
+
+    uint64_t seq = 0;
+    struct msg_batch *batch = batch_new(seq++);
+    uint8_t *msg = NULL;
+    size_t cap = 0;
+    while (1)
+    {
+        ssize_t len;
+        if (conf->prefixed)
+        {
+            uint8_t prefix[4];
+            if (fread(prefix, 1, 4, stdin) != 4) break;
+            len = prefix[0] | (prefix[1] << 8) | (prefix[2] << 16) | ((uint32_t) prefix[3] << 24);
+            if (len > cap) msg = realloc(msg, cap = len);
+            if (fread(msg, 1, len, stdin) != len)
+            {
+                fprintf(stderr, "Truncated message at end of input\n");
+                break;
+            }
+        }
+        else
+        {
+            if ((len = getline((char **) &msg, &cap, stdin)) < 0) break;
+            if (len && msg[len - 1] == '\n') len--;
+        }
+
+        batch_add(batch, msg, len);
+        if (batch->count == BATCH_SIZE || batch->data_len >= BATCH_BYTES)
+        {
+            send_batch(state->todo, batch);
+            batch = batch_new(seq++);
+        }
+    }
+    if (batch->count) send_batch(state->todo, batch);
+    else
+    {
+        batch_free(batch);
+        seq--;
+    }
+    free(msg);
+
+    // Tell the workers and the writer where the stream ends
+    __atomic_store_n(&state->nbatches, seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&state->reading, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Hash every message in a batch, and format the digests
+static void hash_batch(const struct batch_conf *conf, struct msg_batch *batch,
+                       struct msg_ref *refs, uint8_t *scratch, uint8_t *digests)
+{
+    const struct hash_algo *algo = conf->algo;
+    const size_t dig = algo->dig_size;
+
+    // Messages of the same length are gathered together for the batch engines
+    for (size_t idx = 0; idx < batch->count; idx++) refs[idx] = (struct msg_ref) { batch->lens[idx], idx };
+    qsort(refs, batch->count, sizeof(struct msg_ref), cmp_msg_ref);
+    for (size_t idx = 0, end; idx < batch->count; idx = end)
+    {
+        size_t len = refs[idx].len;
+        for (end = idx; end < batch->count && refs[end].len == len; end++)
+        {
+            memcpy(scratch + (end - idx) * len, batch->data + batch->offs[refs[end].idx], len);
+        }
+        hash_many(algo, scratch, end - idx, len, conf->rounds, digests + idx * dig);
+    }
+
+    // then written out in their original order
+    const size_t line = conf->binary? dig : 2 * dig + 1;
+    batch->out = malloc(batch->count * line + 1);
+    for (size_t idx = 0; idx < batch->count; idx++)
+    {
+        uint8_t *pos = batch->out + refs[idx].idx * line;
+        if (conf->binary) memcpy(pos, digests + idx * dig, dig);
+        else
+        {
+            to_hex(digests + idx * dig, dig, (char *) pos);
+            pos[2 * dig] = '\n';
+        }
+    }
+    batch->out_len = batch->count * line;
+}
+
+// Worker thread; hashes batches until the reader has finished and none are left
+static void *batch_worker_main(void *arg)
+{
+    struct batch_state *state = (struct batch_state *) arg;
+    const struct batch_conf *conf = state->conf;
+
+    struct msg_ref *refs = malloc(BATCH_SIZE * sizeof(struct msg_ref));
+    uint8_t *digests = malloc(BATCH_SIZE * conf->algo->dig_size);
+    uint8_t *scratch = NULL;
+    size_t scratch_cap = 0;
+    struct msg_batch *batch;
+    while (1)
+    {
+        // Check whether reading has finished before popping, so no batch is missed
+        int reading = __atomic_load_n(&state->reading, __ATOMIC_ACQUIRE);
+        if (!channel_try_pop(state->todo, &batch))
+        {
+            if (!reading) break;
+            sleep_ms(1);
+            continue;
+        }
+
+        // Keep the reorder buffer bounded by not running too far ahead of the writer
+        while (batch->seq >= __atomic_load_n(&state->written, __ATOMIC_ACQUIRE) + state->window) sleep_ms(1);
+
+        if (batch->data_len > scratch_cap) scratch = realloc(scratch, scratch_cap = batch->data_len);
+        hash_batch(conf, batch, refs, scratch, digests);
+        while (!channel_try_push(state->done, &batch)) sleep_ms(1);
+    }
+    free(refs);
+    free(digests);
+    free(scratch);
+    return NULL;
+}
+
+// Hash every message on stdin, printing the digests in order
+void run_batch(const struct batch_conf *conf)
+{
+    struct batch_state state = { conf };
+    state.window  = 4 * conf->nthreads;
+    state.todo    = channel_new(2 * conf->nthreads, sizeof(struct msg_batch *));
+    state.done    = channel_new(state.window, sizeof(struct msg_batch *));
+    state.reading = 1;
+
+    pthread_t reader, *tids = calloc(conf->nthreads, sizeof(pthread_t));
+    pthread_create(&reader, NULL, batch_reader_main, &state);
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_create(&tids[idx], NULL, batch_worker_main, &state);
+    }
+
+    // Act as the in-order writer. Batches which finish early wait in
+    // pending, at position seq % window, until every batch before them is written
+    struct msg_batch **pending = calloc(state.window, sizeof(struct msg_batch *)), *got;
+    uint64_t written = 0;
+    while (1)
+    {
+        int reading = __atomic_load_n(&state.reading, __ATOMIC_ACQUIRE);
+        if (!reading && written == __atomic_load_n(&state.nbatches, __ATOMIC_RELAXED)) break;
+
+        bool idle = true;
+        while (channel_try_pop(state.done, &got))
+        {
+            pending[got->seq % state.window] = got;
+            idle = false;
+        }
+        while ((got = pending[written % state.window]) && got->seq == written)
+        {
+            fwrite(got->out, 1, got->out_len, stdout);
+            pending[written % state.window] = NULL;
+            batch_free(got);
+            written++;
+        }
+        __atomic_store_n(&state.written, written, __ATOMIC_RELEASE);
+        if (idle) sleep_ms(1);
+    }
+    fflush(stdout);
+
+    pthread_join(reader, NULL);
+    for (size_t idx = 0; idx < conf->nthreads; idx++) pthread_join(tids[idx], NULL);
+    free(tids);
+    free(pending);
+    channel_free(state.todo);
+    channel_free(state.done);
+}
@@ -0,0 +1,37 @@
+// Pipeline for hashing a stream of messages read from stdin
+
+#ifndef __BATCH
+#define __BATCH
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "algo.h"
+
+// Most bytes of message data gathered into one batch
+#define BATCH_BYTES (1 << 20)
+
+// Configuration of a batch run
+struct batch_conf
+{
+    const struct hash_algo *algo;   // Algorithm being run
+    size_t rounds;                  // How many rounds of the algorithm to run
+    bool prefixed;                  // Messages are length-prefixed, rather than one per line
+    bool binary;                    // Write raw digests rather than hex lines
+    size_t nthreads;                // How many worker threads to run
+};
+
+// Hash every message on stdin, writing one digest per message to stdout in
+// the same order. Messages are either one per line, without the newline, or
+// a little-endian 32-bit length followed by that many bytes.
+// The work runs in three stages, joined by bounded queues so that a slow
+// stage holds back the ones before it:
+// - A reader thread splits stdin into batches of up to BATCH_SIZE messages
+// - Worker threads hash each batch, grouping messages of equal length so the
+//   batch engines can be used, and format the digests
+// - The calling thread writes the batches out in order, holding any which
+//   finish early in a reorder buffer
+// Params:
+// - conf: Configuration of the run
+void run_batch(const struct batch_conf *conf);
+
+#endif // __BATCH
@@ -0,0 +1,521 @@
+// Multithreaded birthday search for truncated digests, using sorted runs on
+// disk so that memory use stays bounded however many samples are taken
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "util.h"
+#include "algo.h"
+#include "channel.h"
+#include "threads.h"
+#include "birthday.h"
+
+// Fewest records a run being merged is read through at a time. Merging more
+// runs than the memory allows at this size takes extra passes
+#define BDAY_MIN_READ 4096
+
+// A sample: the leading bits of its digest, and which sample it was
+struct bday_record
+{
+    uint64_t prefix;
+    uint64_t idx;
+};
+
+// A sorted run of records in a worker's file
+struct bday_run
+{
+    int fd;
+    uint64_t offset;                // Where the run starts in the file, in records
+    uint64_t count;                 // How many records it holds
+};
+
+// State shared by every worker
+struct bday_state
+{
+    const struct birthday_conf *conf;
+    uint64_t nchunks;               // How many chunks the samples are split into
+    char pad0[CACHE_LINE];
+    uint64_t claimed;               // Next chunk to be claimed by a worker
+    char pad1[CACHE_LINE];
+};
+
+// State owned by a single worker
+struct bday_worker
+{
+    pthread_t tid;
+    struct bday_state *state;
+    int fd;                         // Unlinked file holding this worker's runs
+    struct bday_record *buf, *tmp;  // Records waiting to be sorted, and space to sort them
+    size_t cap, used;               // Records buf can hold, and how many it does
+    struct bday_run *runs;          // Every run written so far
+    size_t nruns, runs_cap;
+    uint64_t written;               // How many records are in the file
+    uint64_t hashed;                // How many samples have been hashed; read by the main thread
+    int err;                        // errno of a failed write, or 0
+    int done;                       // Set once the worker has finished
+    char pad[CACHE_LINE];
+};
+
+// A run being merged, read through a buffer
+struct bday_cursor
+{
+    struct bday_run run;
+    struct bday_record *buf;
+    size_t cap, pos, len;           // Size of buf, next record in it, and records in it
+    uint64_t read;                  // How many records of the run have been read into buf
+};
+
+// Runs being merged through a min-heap of cursors
+struct bday_merger
+{
+    struct bday_cursor *cursors, **heap;
+    size_t nruns, len;              // How many runs there are, and how many are still in the heap
+    bool ok;                        // Cleared if a run could not be read to the end
+};
+
+// Set by ^C; tells everybody to wrap up
+static volatile sig_atomic_t interrupted = 0;
+static void on_interrupt(int sig) { interrupted = 1; }
+
+// Write the message for sample idx. The mixing is a bijection, so every
+// sample is distinct
+static inline void bday_message(uint64_t seed, uint64_t idx, uint8_t *msg)
+{
+    uint64_t z = seed + idx * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    for (size_t off = 0; off < 8; off++) msg[7 - off] = z >> (8 * off);
+}
+
+// The leading bits of a digest, as an integer
+static inline uint64_t bday_prefix(const uint8_t *digest, size_t dig, uint32_t bits)
+{
+    size_t nbytes = dig < 8? dig : 8;
+    uint64_t x = 0;
+    for (size_t idx = 0; idx < nbytes; idx++) x = (x << 8) | digest[idx];
+    return x >> (8 * nbytes - bits);
+}
+
+// Write bytes bytes of data to fd in full
+// Returns: 0, or the errno of the failed write
+static int bday_write(int fd, const void *data, size_t bytes)
+{
+    const uint8_t *ptr = (const uint8_t *) data;
+    while (bytes)
+    {
+        ssize_t put = write(fd, ptr, bytes);
+        if (put < 0 && errno == EINTR) continue;
+        if (put < 0) return errno;
+        ptr += put;
+        bytes -= put;
+    }
+    return 0;
+}
+
+// Make an unlinked file in tmpdir, which vanishes however the run ends
+// Returns: Its descriptor, or -1 having printed why
+static int bday_tmpfile(const char *tmpdir)
+{
+    char *path = malloc(strlen(tmpdir) + 32);
+    sprintf(path, "%s/birthday-XXXXXX", tmpdir);
+    int fd = mkstemp(path);
+    if (fd < 0) fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    else unlink(path);
+    free(path);
+    return fd;
+}
+
+// Sort a worker's records by prefix and append them to its file as a run
+static void bday_flush(struct bday_worker *worker)
+{
+    const uint32_t bits = worker->state->conf->bits;
+    if (!worker->used || worker->err) return;
+
+    // A radix sort, a byte of the prefix at a time
+    struct bday_record *src = worker->buf, *dst = worker->tmp;
+    for (uint32_t shift = 0; shift < bits; shift += 8)
+    {
+        size_t offs[256] = { 0 };
+        for (size_t idx = 0; idx < worker->used; idx++) offs[(src[idx].prefix >> shift) & 0xff]++;
+        for (size_t b = 0, sum = 0; b < 256; b++)
+        {
+            size_t count = offs[b];
+            offs[b] = sum;
+            sum += count;
+        }
+        for (size_t idx = 0; idx < worker->used; idx++) dst[offs[(src[idx].prefix >> shift) & 0xff]++] = src[idx];
+        struct bday_record *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if ((worker->err = bday_write(worker->fd, src, worker->used * sizeof(struct bday_record)))) return;
+
+    if (worker->nruns == worker->runs_cap)
+    {
+        worker->runs_cap = worker->runs_cap? 2 * worker->runs_cap : 16;
+        worker->runs = realloc(worker->runs, worker->runs_cap * sizeof(struct bday_run));
+    }
+    worker->runs[worker->nruns++] = (struct bday_run) { worker->fd, worker->written, worker->used };
+    worker->written += worker->used;
+    worker->used = 0;
+}
+
+// Worker thread; claims chunks of samples, hashes them, and writes sorted runs
+static void *bday_worker_main(void *arg)
+{
+    struct bday_worker *worker = (struct bday_worker *) arg;
+    struct bday_state *state = worker->state;
+    const struct birthday_conf *conf = state->conf;
+    const size_t dig = conf->algo->dig_size;
+
+    uint8_t *msgs = malloc(BATCH_SIZE * 8), *digests = malloc(BATCH_SIZE * dig);
+    while (!interrupted && !worker->err)
+    {
+        uint64_t seq = __atomic_fetch_add(&state->claimed, 1, __ATOMIC_RELAXED);
+        if (seq >= state->nchunks) break;
+        uint64_t first = seq * BIRTHDAY_CHUNK;
+        uint64_t end = conf->samples - first < BIRTHDAY_CHUNK? conf->samples : first + BIRTHDAY_CHUNK;
+
+        for (uint64_t base = first; base < end; base += BATCH_SIZE)
+        {
+            size_t count = end - base < BATCH_SIZE? end - base : BATCH_SIZE;
+            for (size_t idx = 0; idx < count; idx++) bday_message(conf->seed, base + idx, msgs + idx * 8);
+            hash_many(conf->algo, msgs, count, 8, conf->rounds, digests);
+            for (size_t idx = 0; idx < count; idx++)
+            {
+                if (worker->used == worker->cap) bday_flush(worker);
+                worker->buf[worker->used++] = (struct bday_record) {
+                    bday_prefix(digests + idx * dig, dig, conf->bits), base + idx
+                };
+            }
+        }
+        __atomic_store_n(&worker->hashed, worker->hashed + (end - first), __ATOMIC_RELAXED);
+    }
+    bday_flush(worker);
+    free(msgs);
+    free(digests);
+    __atomic_store_n(&worker->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Fill a cursor's buffer from its run
+// Returns: false if the run is exhausted, or could not be read
+static bool bday_refill(struct bday_cursor *cur)
+{
+    size_t want = cur->run.count - cur->read < cur->cap? cur->run.count - cur->read : cur->cap;
+    if (!want) return false;
+    uint8_t *data = (uint8_t *) cur->buf;
+    size_t got = 0, bytes = want * sizeof(struct bday_record);
+    off_t offset = (cur->run.offset + cur->read) * sizeof(struct bday_record);
+    while (got < bytes)
+    {
+        ssize_t n = pread(cur->run.fd, data + got, bytes - got, offset + got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0)
+        {
+            fprintf(stderr, "Unable to read a run: %s\n", n? strerror(errno) : "unexpected end of file");
+            return false;
+        }
+        got += n;
+    }
+    cur->read += want;
+    cur->pos = 0;
+    cur->len = want;
+    return true;
+}
+
+// Whether cursor x's next record sorts before cursor y's
+static inline bool bday_before(const struct bday_cursor *x, const struct bday_cursor *y)
+{
+    const struct bday_record *a = &x->buf[x->pos], *b = &y->buf[y->pos];
+    return a->prefix < b->prefix || (a->prefix == b->prefix && a->idx < b->idx);
+}
+
+// Restore the min-heap of cursors below position idx
+static void bday_sift(struct bday_cursor **heap, size_t len, size_t idx)
+{
+    while (1)
+    {
+        size_t least = idx, left = 2 * idx + 1, right = 2 * idx + 2;
+        if (left  < len && bday_before(heap[left],  heap[least])) least = left;
+        if (right < len && bday_before(heap[right], heap[least])) least = right;
+        if (least == idx) return;
+        struct bday_cursor *swap = heap[idx];
+        heap[idx] = heap[least];
+        heap[least] = swap;
+        idx = least;
+    }
+}
+
+// Start merging nruns runs, reading each through a buffer of cap records
+static void bday_merger_open(struct bday_merger *m, const struct bday_run *runs, size_t nruns, size_t cap)
+{
+    m->cursors = calloc(nruns, sizeof(struct bday_cursor));
+    m->heap    = calloc(nruns, sizeof(struct bday_cursor *));
+    m->nruns   = nruns;
+    m->len     = 0;
+    m->ok      = true;
+    for (size_t idx = 0; idx < nruns; idx++)
+    {
+        m->cursors[idx].run = runs[idx];
+        m->cursors[idx].cap = cap;
+        m->cursors[idx].buf = malloc(cap * sizeof(struct bday_record));
+        if (bday_refill(&m->cursors[idx])) m->heap[m->len++] = &m->cursors[idx];
+        else m->ok = false;
+    }
+    for (size_t idx = m->len; idx--;) bday_sift(m->heap, m->len, idx);
+}
+
+// Take the least record left in any of the runs
+// Returns: false once every run is exhausted
+static inline bool bday_merger_next(struct bday_merger *m, struct bday_record *rec)
+{
+    if (!m->len) return false;
+    struct bday_cursor *cur = m->heap[0];
+    *rec = cur->buf[cur->pos++];
+    if (cur->pos == cur->len && !bday_refill(cur))
+    {
+        m->ok &= cur->read == cur->run.count;
+        m->heap[0] = m->heap[--m->len];
+    }
+    bday_sift(m->heap, m->len, 0);
+    return true;
+}
+
+// Free the buffers of a merger
+static void bday_merger_close(struct bday_merger *m)
+{
+    for (size_t idx = 0; idx < m->nruns; idx++) free(m->cursors[idx].buf);
+    free(m->cursors);
+    free(m->heap);
+}
+
+// Merge groups of runs into longer runs in a new file, a pass at a time, until
+// there are at most fanin of them. Each pass reads fanin - 1 runs at once and
+// writes through one more buffer, so stays within the memory. *fd holds the
+// file of the last pass, which is closed once the next one has been written
+// Returns: Whether every pass was written in full
+static bool bday_reduce(const struct birthday_conf *conf, struct bday_run *runs, size_t *nruns,
+                        size_t fanin, int *fd)
+{
+    const size_t cap = conf->memory / sizeof(struct bday_record) / fanin;
+    struct bday_record *out = malloc(cap * sizeof(struct bday_record));
+    bool ok = true;
+    while (*nruns > fanin && ok && !interrupted)
+    {
+        int next = bday_tmpfile(conf->tmpdir);
+        if (next < 0)
+        {
+            ok = false;
+            break;
+        }
+        // Merged runs are written back over the front of runs, behind the ones being read
+        size_t merged = 0;
+        uint64_t written = 0;
+        for (size_t first = 0; first < *nruns && ok && !interrupted; first += fanin - 1)
+        {
+            size_t group = *nruns - first < fanin - 1? *nruns - first : fanin - 1;
+            struct bday_merger m;
+            bday_merger_open(&m, runs + first, group, cap);
+            struct bday_run run = { next, written, 0 };
+            size_t used = 0;
+            int err = 0;
+            while (!err && !interrupted && bday_merger_next(&m, &out[used]))
+            {
+                if (++used < cap) continue;
+                err = bday_write(next, out, used * sizeof(struct bday_record));
+                run.count += used;
+                used = 0;
+            }
+            if (!err) err = bday_write(next, out, used * sizeof(struct bday_record));
+            run.count += used;
+            if (err) fprintf(stderr, "Unable to write a run: %s\n", strerror(err));
+            ok = m.ok && !err;
+            bday_merger_close(&m);
+            runs[merged++] = run;
+            written += run.count;
+        }
+        log_line(stderr, "Merged %zu runs into %zu", *nruns, merged);
+        *nruns = merged;
+        if (*fd >= 0) close(*fd);
+        *fd = next;
+    }
+    free(out);
+    return ok && !interrupted;
+}
+
+// Print a colliding pair of samples
+static void bday_print(const struct birthday_conf *conf, uint64_t x, uint64_t y, char *hashbuf)
+{
+    const size_t dig = conf->algo->dig_size;
+    uint8_t msg[8], digest[MAX_BLOCK_SIZE];
+    for (size_t idx = 0; idx < 2; idx++)
+    {
+        bday_message(conf->seed, idx? y : x, msg);
+        printf(idx? "%s => " : "%s - ", to_hex(msg, 8, hashbuf));
+    }
+    for (size_t idx = 0; idx < 2; idx++)
+    {
+        bday_message(conf->seed, idx? y : x, msg);
+        conf->algo->hash_raw(msg, 8, conf->rounds, digest);
+        printf(idx? "%s\n" : "%s ", to_hex(digest, dig, hashbuf));
+    }
+}
+
+// Merge every run, reporting each group of records with the same prefix
+// Returns: Whether every run was read to the end
+static bool bday_merge(const struct birthday_conf *conf, struct bday_worker *workers)
+{
+    size_t total = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++) total += workers[idx].nruns;
+    if (!total) return true;
+    struct bday_run *runs = malloc(total * sizeof(struct bday_run));
+    size_t nruns = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        memcpy(runs + nruns, workers[idx].runs, workers[idx].nruns * sizeof(struct bday_run));
+        nruns += workers[idx].nruns;
+    }
+
+    // Every run gets an equal share of the memory to read through, of at
+    // least BDAY_MIN_READ records; any more runs are merged down first
+    size_t fanin = conf->memory / sizeof(struct bday_record) / BDAY_MIN_READ;
+    int fd = -1;
+    bool ok = bday_reduce(conf, runs, &nruns, fanin, &fd);
+    struct bday_merger m;
+    bday_merger_open(&m, runs, ok? nruns : 0, ok? conf->memory / sizeof(struct bday_record) / nruns : 0);
+
+    // Each record is compared with the first record of its group
+    char *hashbuf = malloc(2*MAX_BLOCK_SIZE + 1);
+    struct bday_record group = { 0 };
+    uint64_t members = 0, merged = 0, groups = 0;
+    double pairs = 0, last = now_seconds();
+    struct bday_record rec;
+    while (!interrupted && bday_merger_next(&m, &rec))
+    {
+        if (members && rec.prefix == group.prefix)
+        {
+            bday_print(conf, group.idx, rec.idx, hashbuf);
+            pairs += members++;
+            groups += members == 2;
+        }
+        else
+        {
+            group = rec;
+            members = 1;
+        }
+
+        if (!(++merged & 0xfffff))
+        {
+            double now = now_seconds();
+            if (now - last >= STATUS_INTERVAL)
+            {
+                log_line(stderr, "%llu/%llu records merged", (unsigned long long) merged,
+                         (unsigned long long) conf->samples);
+                last = now;
+            }
+        }
+    }
+    fflush(stdout);
+
+    printf("Samples: %llu in %zu runs\n", (unsigned long long) merged, total);
+    printf("Colliding pairs: %.0f in %llu groups (expected %.3f)\n", pairs, (unsigned long long) groups,
+           (double) conf->samples * (conf->samples - 1) / 2 * ldexp(1.0, -(int) conf->bits));
+    ok = ok && m.ok;
+    bday_merger_close(&m);
+    if (fd >= 0) close(fd);
+    free(runs);
+    free(hashbuf);
+    return ok && !interrupted;
+}
+
+// Search for collisions between the samples
+bool run_birthday(const struct birthday_conf *conf)
+{
+    struct bday_state state = { conf };
+    state.nchunks = (conf->samples + BIRTHDAY_CHUNK - 1) / BIRTHDAY_CHUNK;
+    signal(SIGINT, on_interrupt);
+
+    // Merging needs room for at least three runs' buffers at once
+    if (conf->memory < 3 * BDAY_MIN_READ * sizeof(struct bday_record))
+    {
+        fprintf(stderr, "Need at least %zu KiB of memory to merge runs\n",
+                3 * BDAY_MIN_READ * sizeof(struct bday_record) >> 10);
+        return false;
+    }
+
+    // Every worker gets an equal share of the memory, half of it to sort into
+    size_t cap = conf->memory / (2 * sizeof(struct bday_record)) / conf->nthreads;
+    if (cap < BATCH_SIZE) cap = BATCH_SIZE;
+    struct bday_worker *workers = calloc(conf->nthreads, sizeof(struct bday_worker));
+    bool ok = true;
+    for (size_t idx = 0; idx < conf->nthreads; idx++) workers[idx].fd = -1;
+    for (size_t idx = 0; idx < conf->nthreads && ok; idx++)
+    {
+        workers[idx].fd = bday_tmpfile(conf->tmpdir);
+        ok = workers[idx].fd >= 0;
+    }
+    size_t started = 0;
+    for (; started < conf->nthreads && ok; started++)
+    {
+        const size_t idx = started;
+        workers[idx].state = &state;
+        workers[idx].cap   = cap;
+        workers[idx].buf   = malloc(cap * sizeof(struct bday_record));
+        workers[idx].tmp   = malloc(cap * sizeof(struct bday_record));
+        pthread_create(&workers[idx].tid, NULL, bday_worker_main, &workers[idx]);
+    }
+
+    // Report progress until every sample has been hashed and written
+    uint64_t last_hashed = 0;
+    double last = now_seconds();
+    while (started)
+    {
+        size_t finished = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++)
+            finished += __atomic_load_n(&workers[idx].done, __ATOMIC_ACQUIRE);
+        if (finished == conf->nthreads) break;
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            uint64_t hashed = 0;
+            for (size_t idx = 0; idx < conf->nthreads; idx++)
+                hashed += __atomic_load_n(&workers[idx].hashed, __ATOMIC_RELAXED);
+            log_line(stderr, "%llu/%llu samples (%.3e/s)", (unsigned long long) hashed,
+                     (unsigned long long) conf->samples, (hashed - last_hashed) / (now - last));
+            last_hashed = hashed;
+            last = now;
+        }
+        sleep_ms(10);
+    }
+    for (size_t idx = 0; idx < started; idx++)
+    {
+        pthread_join(workers[idx].tid, NULL);
+        free(workers[idx].buf);
+        free(workers[idx].tmp);
+        if (workers[idx].err)
+        {
+            fprintf(stderr, "Unable to write a run: %s\n", strerror(workers[idx].err));
+            ok = false;
+        }
+    }
+    ok = ok && !interrupted && bday_merge(conf, workers);
+
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        if (workers[idx].fd >= 0) close(workers[idx].fd);
+        free(workers[idx].runs);
+    }
+    free(workers);
+    return ok;
+}
@@ -0,0 +1,45 @@
+// Multithreaded birthday search for truncated digests, using sorted runs on
+// disk so that memory use stays bounded however many samples are taken
+
+#ifndef __BIRTHDAY
+#define __BIRTHDAY
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "algo.h"
+
+// How many consecutive samples make up one chunk of work
+#define BIRTHDAY_CHUNK (16 * BATCH_SIZE)
+
+// Configuration of a birthday search
+struct birthday_conf
+{
+    const struct hash_algo *algo;   // Algorithm being attacked
+    size_t rounds;                  // How many rounds of the algorithm to run
+    uint32_t bits;                  // How many leading bits of the digest must collide
+    uint64_t samples;               // How many messages to hash
+    size_t memory;                  // Most bytes to use for buffering records
+    const char *tmpdir;             // Directory for the runs
+    size_t nthreads;                // How many worker threads to run
+    uint64_t seed;                  // Picks which messages are sampled
+};
+
+// Hash samples distinct 8-byte messages, where message i is a fixed mixing
+// of seed + i, and find every pair whose digests agree in their leading bits.
+// Workers claim chunks of samples in turn, and gather a 16-byte record of the
+// digest prefix and sample index for each. Whenever a worker's share of the
+// memory is full, it radix sorts the records and appends them to its own
+// unlinked file in tmpdir as a sorted run. Once every sample is taken, the
+// runs are merged with a heap, each read through its own share of the memory,
+// and records with equal prefixes are reported. If there are too many runs
+// for each share to hold a few thousand records, they are first merged into
+// fewer, longer runs in extra passes, so the merge stays within the memory.
+// Each collision is printed to stdout as "input1 - input2 => digest1
+// digest2", and progress is reported to stderr. Fails if memory cannot hold
+// three runs' read buffers.
+// Params:
+// - conf: Configuration of the search
+// Returns: Whether the search ran to the end
+bool run_birthday(const struct birthday_conf *conf);
+
+#endif // __BIRTHDAY
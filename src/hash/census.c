@@ -0,0 +1,345 @@
+// Multithreaded exhaustive count of the digests of every input of a fixed shape
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "util.h"
+#include "algo.h"
+#include "channel.h"
+#include "threads.h"
+#include "census.h"
+
+// Number of keys, each the leading 32 bits of a digest
+#define CENSUS_KEYS ((uint64_t) 1 << 32)
+
+// A key hit more than 15 times
+struct census_spill
+{
+    uint64_t key;                   // The key plus one, or 0 if the slot is free
+    uint64_t count;                 // How many hits there were beyond 15
+};
+
+// An input listed in the second pass
+struct census_hit
+{
+    uint32_t key;
+    uint32_t idx;                   // Suffix of the input
+};
+
+// State shared by every worker
+struct census_state
+{
+    const struct census_conf *conf;
+    uint64_t *counters;             // A 4-bit counter for every key, 16 to a word
+    struct census_spill *spill;     // Open-addressed table of keys whose counter is full
+    uint64_t total;                 // How many inputs there are
+    uint64_t nchunks;               // How many chunks the inputs are split into
+    bool listing;                   // Whether this pass lists inputs, rather than counting them
+    char pad0[CACHE_LINE];
+    uint64_t claimed;               // Next chunk to be claimed by a worker
+    char pad1[CACHE_LINE];
+    uint64_t hashed;                // How many inputs have been hashed; read by the main thread
+    char pad2[CACHE_LINE];
+    uint64_t spilled;               // How many slots of spill are in use
+    uint64_t lost;                  // Hits which could not be counted as spill was full
+    char pad3[CACHE_LINE];
+};
+
+// State owned by a single worker
+struct census_worker
+{
+    pthread_t tid;
+    struct census_state *state;
+    struct census_hit *hits;        // Inputs listed by this worker
+    size_t nhits, hits_cap;
+    int done;                       // Set once the worker has finished the pass
+    char pad[CACHE_LINE];
+};
+
+// Slot at which the search for key in the spill table starts
+static inline uint64_t spill_slot(uint32_t key)
+{
+    return ((uint64_t) key * 0x9e3779b97f4a7c15ULL) >> 40;
+}
+
+// Count a hit of a key whose counter is full
+static void spill_add(struct census_state *state, uint32_t key)
+{
+    for (uint64_t slot = spill_slot(key);; slot++)
+    {
+        struct census_spill *entry = &state->spill[slot & (CENSUS_SPILL - 1)];
+        uint64_t seen = __atomic_load_n(&entry->key, __ATOMIC_ACQUIRE);
+        if (!seen)
+        {
+            // Leave some slots free, so that lookups always end
+            if (__atomic_load_n(&state->spilled, __ATOMIC_RELAXED) >= CENSUS_SPILL / 4 * 3)
+            {
+                __atomic_fetch_add(&state->lost, 1, __ATOMIC_RELAXED);
+                return;
+            }
+            if (!__atomic_compare_exchange_n(&entry->key, &seen, (uint64_t) key + 1, false,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                // Somebody else claimed the slot first; look at what they put there
+                slot--;
+                continue;
+            }
+            __atomic_fetch_add(&state->spilled, 1, __ATOMIC_RELAXED);
+            seen = (uint64_t) key + 1;
+        }
+        if (seen == (uint64_t) key + 1)
+        {
+            __atomic_fetch_add(&entry->count, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    }
+}
+
+// How many hits beyond 15 a key had
+static uint64_t spill_count(const struct census_state *state, uint32_t key)
+{
+    for (uint64_t slot = spill_slot(key);; slot++)
+    {
+        const struct census_spill *entry = &state->spill[slot & (CENSUS_SPILL - 1)];
+        if (!entry->key) return 0;
+        if (entry->key == (uint64_t) key + 1) return entry->count;
+    }
+}
+
+// Count a hit of a key
+static inline void census_count(struct census_state *state, uint32_t key)
+{
+    uint64_t *word = &state->counters[key >> 4];
+    const int shift = (key & 15) * 4;
+    uint64_t old = __atomic_load_n(word, __ATOMIC_RELAXED);
+    do
+    {
+        if (((old >> shift) & 15) == 15)
+        {
+            spill_add(state, key);
+            return;
+        }
+    }
+    while (!__atomic_compare_exchange_n(word, &old, old + ((uint64_t) 1 << shift), true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+// How many times a key was hit, once counting has finished
+static inline uint64_t census_multiplicity(const struct census_state *state, uint32_t key)
+{
+    uint64_t count = (state->counters[key >> 4] >> ((key & 15) * 4)) & 15;
+    return count == 15? count + spill_count(state, key) : count;
+}
+
+// Worker thread; claims chunks and counts, or lists, their inputs
+static void *census_worker_main(void *arg)
+{
+    struct census_worker *worker = (struct census_worker *) arg;
+    struct census_state *state = worker->state;
+    const struct census_conf *conf = state->conf;
+    const struct hash_algo *algo = conf->algo;
+    const size_t plen = conf->prefix_len, slen = conf->suffix_len, len = plen + slen, dig = algo->dig_size;
+
+    // Every input starts with the prefix, so it is only written once
+    uint8_t *batch = malloc(BATCH_SIZE * len + 1), *digests = malloc(BATCH_SIZE * dig);
+    for (size_t idx = 0; idx < BATCH_SIZE; idx++) memcpy(batch + idx * len, conf->prefix, plen);
+    while (1)
+    {
+        uint64_t seq = __atomic_fetch_add(&state->claimed, 1, __ATOMIC_RELAXED);
+        if (seq >= state->nchunks) break;
+        uint64_t first = seq * CENSUS_CHUNK, end = first + CENSUS_CHUNK;
+        if (end > state->total) end = state->total;
+
+        for (uint64_t base = first; base < end; base += BATCH_SIZE)
+        {
+            size_t count = end - base < BATCH_SIZE? end - base : BATCH_SIZE;
+            for (size_t idx = 0; idx < count; idx++)
+            {
+                uint8_t *suffix = batch + idx * len + plen;
+                for (size_t off = 0; off < slen; off++) suffix[slen - off - 1] = (base + idx) >> (8 * off);
+            }
+            hash_many(algo, batch, count, len, conf->rounds, digests);
+
+            for (size_t idx = 0; idx < count; idx++)
+            {
+                const uint8_t *d = digests + idx * dig;
+                uint32_t key = ((uint32_t) d[0] << 24) | ((uint32_t) d[1] << 16) | ((uint32_t) d[2] << 8) | d[3];
+                if (!state->listing) census_count(state, key);
+                else if (census_multiplicity(state, key) >= conf->list_min)
+                {
+                    if (worker->nhits == worker->hits_cap)
+                    {
+                        worker->hits_cap = worker->hits_cap? 2 * worker->hits_cap : 1024;
+                        worker->hits = realloc(worker->hits, worker->hits_cap * sizeof(struct census_hit));
+                    }
+                    worker->hits[worker->nhits++] = (struct census_hit) { key, base + idx };
+                }
+            }
+        }
+        __atomic_fetch_add(&state->hashed, end - first, __ATOMIC_RELAXED);
+    }
+    free(batch);
+    free(digests);
+    __atomic_store_n(&worker->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Run every worker over every input once, reporting progress
+static void census_pass(struct census_state *state, struct census_worker *workers, const char *what)
+{
+    const struct census_conf *conf = state->conf;
+    state->claimed = 0;
+    state->hashed  = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        workers[idx].state = state;
+        workers[idx].done  = 0;
+        pthread_create(&workers[idx].tid, NULL, census_worker_main, &workers[idx]);
+    }
+
+    uint64_t last_hashed = 0;
+    double last = now_seconds();
+    while (1)
+    {
+        size_t finished = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++)
+            finished += __atomic_load_n(&workers[idx].done, __ATOMIC_ACQUIRE);
+        if (finished == conf->nthreads) break;
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            uint64_t hashed = __atomic_load_n(&state->hashed, __ATOMIC_RELAXED);
+            log_line(stderr, "%s %llu/%llu inputs (%.3e/s)", what, (unsigned long long) hashed,
+                     (unsigned long long) state->total, (hashed - last_hashed) / (now - last));
+            last_hashed = hashed;
+            last = now;
+        }
+        sleep_ms(10);
+    }
+    for (size_t idx = 0; idx < conf->nthreads; idx++) pthread_join(workers[idx].tid, NULL);
+}
+
+static int cmp_uint64(const void *x, const void *y)
+{
+    uint64_t a = *(const uint64_t *) x, b = *(const uint64_t *) y;
+    return (a > b) - (a < b);
+}
+
+static int cmp_census_hit(const void *x, const void *y)
+{
+    const struct census_hit *a = x, *b = y;
+    if (a->key != b->key) return (a->key > b->key) - (a->key < b->key);
+    return (a->idx > b->idx) - (a->idx < b->idx);
+}
+
+// Print how many keys were hit k times, against a random function's
+// Poisson-distributed counts, and return the number of colliding pairs
+static double census_row(uint64_t k, uint64_t keys, double lambda)
+{
+    double expect = exp(32 * M_LN2 - lambda + (k? k * log(lambda) : 0.0) - lgamma(k + 1.0));
+    printf("  %llu: %llu (expected %.3f)\n", (unsigned long long) k, (unsigned long long) keys, expect);
+    return keys * (k * (k - 1.0) / 2);
+}
+
+// Count the digests of every input
+void run_census(const struct census_conf *conf)
+{
+    struct census_state state = { conf };
+    state.total    = (uint64_t) 1 << (8 * conf->suffix_len);
+    state.nchunks  = (state.total + CENSUS_CHUNK - 1) / CENSUS_CHUNK;
+    state.counters = calloc(CENSUS_KEYS / 16, sizeof(uint64_t));
+    state.spill    = calloc(CENSUS_SPILL, sizeof(struct census_spill));
+    if (!state.counters || !state.spill)
+    {
+        fprintf(stderr, "Unable to allocate the counters\n");
+        return;
+    }
+
+    struct census_worker *workers = calloc(conf->nthreads, sizeof(struct census_worker));
+    double begin = now_seconds();
+    census_pass(&state, workers, "Counted");
+    fprintf(stderr, "Counted %llu inputs in %.3fs\n", (unsigned long long) state.total, now_seconds() - begin);
+
+    // Tally the counters, skipping the words which were never hit
+    uint64_t hist[16] = { 0 };
+    for (uint64_t word = 0; word < CENSUS_KEYS / 16; word++)
+    {
+        uint64_t w = state.counters[word];
+        if (!w)
+        {
+            hist[0] += 16;
+            continue;
+        }
+        for (int nib = 0; nib < 16; nib++) hist[(w >> (4 * nib)) & 15]++;
+    }
+
+    // Keys which spilled over each have their own count
+    uint64_t *spilled = malloc((state.spilled + 1) * sizeof(uint64_t)), nspilled = 0;
+    for (size_t slot = 0; slot < CENSUS_SPILL; slot++)
+    {
+        if (state.spill[slot].key) spilled[nspilled++] = 15 + state.spill[slot].count;
+    }
+    qsort(spilled, nspilled, sizeof(uint64_t), cmp_uint64);
+    hist[15] -= nspilled;
+
+    const double lambda = ldexp((double) state.total, -32);
+    double pairs = 0;
+    printf("Inputs: %llu (2^%.3f)\n", (unsigned long long) state.total, log2((double) state.total));
+    printf("Keys hit k times:\n");
+    for (uint64_t k = 0; k < 16; k++)
+    {
+        if (hist[k] || k < 4) pairs += census_row(k, hist[k], lambda);
+    }
+    for (uint64_t idx = 0, end; idx < nspilled; idx = end)
+    {
+        for (end = idx; end < nspilled && spilled[end] == spilled[idx]; end++);
+        pairs += census_row(spilled[idx], end - idx, lambda);
+    }
+    printf("Distinct digests: %llu\n", (unsigned long long) (CENSUS_KEYS - hist[0]));
+    printf("Colliding pairs: %.0f (expected %.3f)\n", pairs, (double) state.total * (state.total - 1) / 2 * ldexp(1.0, -32));
+    if (state.lost) printf("The spill table filled up; %llu hits were not counted\n", (unsigned long long) state.lost);
+    fflush(stdout);
+    free(spilled);
+
+    // List the inputs of every key hit often enough
+    if (conf->list_min)
+    {
+        state.listing = true;
+        census_pass(&state, workers, "Listed");
+
+        size_t nhits = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++) nhits += workers[idx].nhits;
+        struct census_hit *hits = malloc((nhits + 1) * sizeof(struct census_hit));
+        nhits = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++)
+        {
+            memcpy(hits + nhits, workers[idx].hits, workers[idx].nhits * sizeof(struct census_hit));
+            nhits += workers[idx].nhits;
+            free(workers[idx].hits);
+        }
+        qsort(hits, nhits, sizeof(struct census_hit), cmp_census_hit);
+
+        char hashbuf[2*MAX_BLOCK_SIZE + 1];
+        uint8_t input[MAX_BLOCK_SIZE];
+        memcpy(input, conf->prefix, conf->prefix_len);
+        for (size_t idx = 0; idx < nhits; idx++)
+        {
+            uint8_t key[4] = { hits[idx].key >> 24, hits[idx].key >> 16, hits[idx].key >> 8, hits[idx].key };
+            for (size_t off = 0; off < conf->suffix_len; off++)
+                input[conf->prefix_len + conf->suffix_len - off - 1] = hits[idx].idx >> (8 * off);
+            printf("%s - ", to_hex(key, 4, hashbuf));
+            printf("0x%s\n", to_hex(input, conf->prefix_len + conf->suffix_len, hashbuf));
+        }
+        fflush(stdout);
+        free(hits);
+    }
+
+    free(workers);
+    free(state.counters);
+    free(state.spill);
+}
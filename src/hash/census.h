@@ -0,0 +1,42 @@
+// Multithreaded exhaustive count of the digests of every input of a fixed shape
+
+#ifndef __CENSUS
+#define __CENSUS
+
+#include <stdint.h>
+#include "algo.h"
+
+// How many consecutive inputs make up one chunk of work
+#define CENSUS_CHUNK (64 * BATCH_SIZE)
+
+// Slots in the table of digests hit more often than a counter can hold
+#define CENSUS_SPILL (1 << 22)
+
+// Configuration of a census
+struct census_conf
+{
+    const struct hash_algo *algo;   // Algorithm being run
+    size_t rounds;                  // How many rounds of the algorithm to run
+    const uint8_t *prefix;          // Bytes at the start of every input
+    size_t prefix_len;              // Length of prefix
+    size_t suffix_len;              // How many bytes, at most 4, follow the prefix
+    uint32_t list_min;              // List the inputs of digests hit at least this often; 0 lists none
+    size_t nthreads;                // How many worker threads to run
+};
+
+// Hash every input made of the prefix followed by a suffix_len-byte
+// big-endian integer, and count how often each digest is hit. Digests are
+// keyed by their leading 32 bits, which for MAW32 is the whole digest. The
+// counts are held in a 2 GiB table of 4-bit counters, one per key, updated
+// with atomic compare-and-swap; keys hit more than 15 times spill over into a
+// lock-free hash table holding their full count. Workers claim chunks of
+// CENSUS_CHUNK consecutive inputs in turn.
+// The number of keys hit exactly k times is printed for every k, along with
+// what a random function would give, and the number of colliding pairs. If
+// list_min is nonzero, every input is then hashed again, and each input whose
+// key was hit at least list_min times is printed, grouped by digest.
+// Params:
+// - conf: Configuration of the census
+void run_census(const struct census_conf *conf);
+
+#endif // __CENSUS
@@ -0,0 +1,100 @@
+// Bounded lock-free channel for passing fixed-size records between threads.
+// Any number of threads may push and pop concurrently; each slot carries a
+// sequence number which tells producers and consumers whose turn it is
+// (Vyukov's bounded MPMC queue).
+
+#ifndef __CHANNEL
+#define __CHANNEL
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Pad hot counters out to their own cache line
+#define CACHE_LINE 64
+
+struct channel
+{
+    size_t mask;                    // Capacity - 1; capacity is a power of two
+    size_t elem_size;               // Size of each record in bytes
+    size_t *seq;                    // Sequence number of each slot
+    uint8_t *data;                  // Storage for capacity records
+    char pad0[CACHE_LINE];
+    size_t head;                    // Next slot to push to
+    char pad1[CACHE_LINE];
+    size_t tail;                    // Next slot to pop from
+    char pad2[CACHE_LINE];
+};
+
+// Create a channel holding at least capacity records of elem_size bytes
+static inline struct channel *channel_new(size_t capacity, size_t elem_size)
+{
+    size_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+    struct channel *chan = (struct channel *) calloc(1, sizeof(struct channel));
+    chan->mask      = cap - 1;
+    chan->elem_size = elem_size;
+    chan->seq       = (size_t *) calloc(cap, sizeof(size_t));
+    chan->data      = (uint8_t *) calloc(cap, elem_size);
+    for (size_t idx = 0; idx < cap; idx++) chan->seq[idx] = idx;
+    return chan;
+}
+
+// Free a channel and everything in it
+static inline void channel_free(struct channel *chan)
+{
+    free(chan->seq);
+    free(chan->data);
+    free(chan);
+}
+
+// Push a copy of elem into the channel; returns false if the channel is full
+static inline bool channel_try_push(struct channel *chan, const void *elem)
+{
+    size_t pos = __atomic_load_n(&chan->head, __ATOMIC_RELAXED);
+    while (1)
+    {
+        size_t *seq = &chan->seq[pos & chan->mask];
+        size_t s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t) s - (intptr_t) pos;
+        if (dif == 0)
+        {
+            // Slot is free; claim it by moving head along
+            if (__atomic_compare_exchange_n(&chan->head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                memcpy(chan->data + (pos & chan->mask) * chan->elem_size, elem, chan->elem_size);
+                __atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        }
+        else if (dif < 0) return false;
+        else pos = __atomic_load_n(&chan->head, __ATOMIC_RELAXED);
+    }
+}
+
+// Pop the oldest record into elem; returns false if the channel is empty
+static inline bool channel_try_pop(struct channel *chan, void *elem)
+{
+    size_t pos = __atomic_load_n(&chan->tail, __ATOMIC_RELAXED);
+    while (1)
+    {
+        size_t *seq = &chan->seq[pos & chan->mask];
+        size_t s = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        intptr_t dif = (intptr_t) s - (intptr_t) (pos + 1);
+        if (dif == 0)
+        {
+            // Slot is full; claim it by moving tail along
+            if (__atomic_compare_exchange_n(&chan->tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                memcpy(elem, chan->data + (pos & chan->mask) * chan->elem_size, chan->elem_size);
+                __atomic_store_n(seq, pos + chan->mask + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        }
+        else if (dif < 0) return false;
+        else pos = __atomic_load_n(&chan->tail, __ATOMIC_RELAXED);
+    }
+}
+
+#endif // __CHANNEL
@@ -0,0 +1,197 @@
+// Multithreaded search for MAW32 message pairs which follow a differential
+// characteristic, using message modification
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sched.h>
+
+#include "util.h"
+#include "algo.h"
+#include "prng.h"
+#include "maw32.h"
+#include "channel.h"
+#include "threads.h"
+#include "conform.h"
+
+// Size of a record sent to the writer: M1 || M2 || digest1 || digest2
+#define CONFORM_RECORD (2*MAW32_BLOCK_SIZE + 2*MAW32_DIGEST_SIZE)
+
+// State shared by every worker
+struct conform_state
+{
+    const struct conform_conf *conf;
+    struct channel *hits;           // Conforming pairs found, as CONFORM_RECORD records
+    uint64_t prefix_diff;           // diff over the first CONFORM_PREFIX bytes, as an integer
+    uint64_t searched;              // How many subtrees are searched; half of them unless prefix_diff is 0
+    int stop;                       // Set once enough pairs have been printed, or on ^C
+    char pad0[CACHE_LINE];
+    uint64_t claimed;               // Next subtree to be claimed by a worker
+    char pad1[CACHE_LINE];
+};
+
+// State owned by a single worker
+struct conform_worker
+{
+    pthread_t tid;
+    struct conform_state *state;
+    struct prng rng;                // This worker's PRNG stream, for the order of each subtree
+    uint64_t subtrees;              // How many subtrees have been searched in full; read by the writer
+    uint64_t *reached;              // Partial pairs which got through each round; read by the writer
+    uint8_t hit[CONFORM_RECORD];
+    int done;                       // Set once the worker has finished
+    char pad[CACHE_LINE];
+};
+
+// Set by ^C; tells everybody to wrap up
+static volatile sig_atomic_t interrupted = 0;
+static void on_interrupt(int sig) { interrupted = 1; }
+
+// Hash a conforming pair in full and pass it on to the writer
+static bool conform_found(const uint8_t *M1, void *arg)
+{
+    struct conform_worker *worker = (struct conform_worker *) arg;
+    struct conform_state *state = worker->state;
+    const struct conform_conf *conf = state->conf;
+    uint8_t *hit = worker->hit, *M2 = hit + MAW32_BLOCK_SIZE, *digests = hit + 2*MAW32_BLOCK_SIZE;
+    memcpy(hit, M1, MAW32_BLOCK_SIZE);
+    for (int k = 0; k < MAW32_BLOCK_SIZE; k++) M2[k] = M1[k] ^ conf->diff[k];
+    // XOR differences are symmetric, so M2 is found as well; only report the pair once. When
+    // the prefixes differ, the subtree holding the larger one is never searched instead
+    if (!state->prefix_diff && memcmp(M1, M2, MAW32_BLOCK_SIZE) > 0)
+    {
+        return !__atomic_load_n(&state->stop, __ATOMIC_RELAXED);
+    }
+    maw32_hash_raw(hit, MAW32_BLOCK_SIZE, conf->rounds, digests);
+    maw32_hash_raw(M2,  MAW32_BLOCK_SIZE, conf->rounds, digests + MAW32_DIGEST_SIZE);
+    // The channel only fills up if the writer falls far behind
+    while (!channel_try_push(state->hits, hit))
+    {
+        if (__atomic_load_n(&state->stop, __ATOMIC_RELAXED)) return false;
+        sched_yield();
+    }
+    return !__atomic_load_n(&state->stop, __ATOMIC_RELAXED);
+}
+
+// Worker thread; claims subtrees and searches them for conforming pairs
+static void *conform_worker_main(void *arg)
+{
+    struct conform_worker *worker = (struct conform_worker *) arg;
+    struct conform_state *state = worker->state;
+    const struct conform_conf *conf = state->conf;
+
+    uint8_t start[MAW32_BLOCK_SIZE];
+    while (!__atomic_load_n(&state->stop, __ATOMIC_RELAXED))
+    {
+        uint64_t seq = __atomic_fetch_add(&state->claimed, 1, __ATOMIC_RELAXED);
+        if (seq >= CONFORM_SUBTREES) break;
+        // Multiplying by an odd constant permutes the subtrees, so the seed picks where to start
+        uint64_t tree = (seq * 0x9e3779b97f4a7c15ULL + conf->seed) % CONFORM_SUBTREES;
+        // Every pair here has M2 in the partner subtree with the smaller prefix, which reports it
+        if ((tree ^ state->prefix_diff) < tree) continue;
+        prng_fill(&worker->rng, start, MAW32_BLOCK_SIZE);
+        for (int k = 0; k < CONFORM_PREFIX; k++) start[k] = tree >> (8 * (CONFORM_PREFIX - 1 - k));
+
+        maw32_conform(start, CONFORM_PREFIX, conf->diff, conf->rounds, conf->expect, conf->mask,
+                      worker->reached, conform_found, worker, &state->stop);
+        if (__atomic_load_n(&state->stop, __ATOMIC_RELAXED)) break;
+        __atomic_store_n(&worker->subtrees, worker->subtrees + 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&worker->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Search for pairs following the characteristic
+void run_conform(const struct conform_conf *conf)
+{
+    struct conform_state state = { conf };
+    state.hits = channel_new(4096, CONFORM_RECORD);
+    for (int k = 0; k < CONFORM_PREFIX; k++) state.prefix_diff = (state.prefix_diff << 8) | conf->diff[k];
+    state.searched = state.prefix_diff? CONFORM_SUBTREES / 2 : CONFORM_SUBTREES;
+    signal(SIGINT, on_interrupt);
+
+    struct conform_worker *workers = calloc(conf->nthreads, sizeof(struct conform_worker));
+    struct prng rng;
+    prng_seed(&rng, conf->seed);
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        workers[idx].state   = &state;
+        workers[idx].rng     = rng;
+        workers[idx].reached = calloc(conf->rounds + 1, sizeof(uint64_t));
+        pthread_create(&workers[idx].tid, NULL, conform_worker_main, &workers[idx]);
+        prng_jump(&rng);
+    }
+
+    // Act as the single writer: print pairs as they come in, and report progress
+    uint8_t hit[CONFORM_RECORD];
+    char hashbuf[2*MAW32_BLOCK_SIZE + 1];
+    uint64_t printed = 0, collisions = 0;
+    double last = now_seconds();
+    while (1)
+    {
+        // Check whether everybody has finished before draining, so no pair is missed
+        size_t finished = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++)
+            finished += __atomic_load_n(&workers[idx].done, __ATOMIC_ACQUIRE);
+
+        bool idle = true;
+        while (channel_try_pop(state.hits, hit))
+        {
+            idle = false;
+            // Workers may overshoot before they notice the search is over
+            if (printed == conf->pairs) continue;
+            const uint8_t *digest1 = hit + 2*MAW32_BLOCK_SIZE, *digest2 = digest1 + MAW32_DIGEST_SIZE;
+            printf("%s - ", to_hex(hit, MAW32_BLOCK_SIZE, hashbuf));
+            printf("%s => ", to_hex(hit + MAW32_BLOCK_SIZE, MAW32_BLOCK_SIZE, hashbuf));
+            printf("%s ", to_hex(digest1, MAW32_DIGEST_SIZE, hashbuf));
+            printf("%s\n", to_hex(digest2, MAW32_DIGEST_SIZE, hashbuf));
+            collisions += digest_equal(digest1, digest2, MAW32_DIGEST_SIZE);
+            if (++printed == conf->pairs) __atomic_store_n(&state.stop, 1, __ATOMIC_RELAXED);
+        }
+        if (!idle) fflush(stdout);
+        if (interrupted) __atomic_store_n(&state.stop, 1, __ATOMIC_RELAXED);
+        if (finished == conf->nthreads) break;
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            // Blocks whose every byte was fixed are those which got through the last message byte
+            size_t full = conf->rounds < MAW32_BLOCK_SIZE? conf->rounds : MAW32_BLOCK_SIZE;
+            uint64_t subtrees = 0, blocks = 0;
+            for (size_t idx = 0; idx < conf->nthreads; idx++)
+            {
+                subtrees += __atomic_load_n(&workers[idx].subtrees, __ATOMIC_RELAXED);
+                if (full) blocks += __atomic_load_n(&workers[idx].reached[full - 1], __ATOMIC_RELAXED);
+            }
+            log_line(stderr, "%llu/%llu subtrees searched, %llu blocks checked, %llu pairs found",
+                     (unsigned long long) subtrees, (unsigned long long) state.searched, (unsigned long long) blocks,
+                     (unsigned long long) printed);
+            last = now;
+        }
+        if (idle) sleep_ms(1);
+    }
+
+    // Report how far partial pairs got through the characteristic
+    uint64_t subtrees = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_join(workers[idx].tid, NULL);
+        subtrees += workers[idx].subtrees;
+    }
+    printf("Subtrees: %llu/%llu\n", (unsigned long long) subtrees, (unsigned long long) state.searched);
+    printf("Pairs: %llu, of which %llu collide\n", (unsigned long long) printed, (unsigned long long) collisions);
+    for (size_t t = 0; t < conf->rounds; t++)
+    {
+        uint64_t reached = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++) reached += workers[idx].reached[t];
+        printf("Round %zu: %llu\n", t + 1, (unsigned long long) reached);
+    }
+    fflush(stdout);
+
+    for (size_t idx = 0; idx < conf->nthreads; idx++) free(workers[idx].reached);
+    free(workers);
+    channel_free(state.hits);
+}
@@ -0,0 +1,45 @@
+// Multithreaded search for MAW32 message pairs which follow a differential
+// characteristic, using message modification
+
+#ifndef __CONFORM
+#define __CONFORM
+
+#include <stdio.h>  // size_t
+#include <stdint.h> // uint8_t, uint64_t
+
+// How many leading message bytes are fixed by each unit of work; the search
+// is split into 256^CONFORM_PREFIX subtrees
+#define CONFORM_PREFIX 2
+#define CONFORM_SUBTREES (1 << (8 * CONFORM_PREFIX))
+
+// Configuration of a conforming pair search
+struct conform_conf
+{
+    size_t rounds;                  // How many rounds of the characteristic must be followed
+    const uint8_t *diff;            // XOR difference between the messages; 8 bytes
+    const uint8_t *expect;          // Expected register difference after each round
+    const uint8_t *mask;            // Bits of expect which must match after each round
+    uint64_t pairs;                 // Stop after finding this many pairs
+    size_t nthreads;                // How many worker threads to run
+    uint64_t seed;                  // Picks the order in which the space is searched
+};
+
+// Search for single-block MAW32 messages M1 such that M1 and M2 = M1 ^ diff
+// follow the characteristic through the first block, with maw32_conform. The
+// space of messages is split into subtrees by their first CONFORM_PREFIX
+// bytes, which workers claim in turn in an order picked by the seed; the
+// seed also picks the order in which the values of the other bytes are
+// tried. Since M2 conforms whenever M1 does, each pair is only reported once.
+// When diff changes the prefix, the partner subtree of each one is M2's, and
+// only the subtree with the smaller prefix of the two is searched; otherwise
+// every subtree is, and pairs are only reported with M1 < M2. Each pair is
+// hashed in full, and printed to stdout as "M1 - M2 => digest1 digest2" as
+// it is found; progress is reported to stderr. The search stops after
+// conf->pairs pairs, once every subtree to search has been searched, or when
+// interrupted with ^C. The number of partial pairs
+// which followed the characteristic through each round is printed at the end.
+// Params:
+// - conf: Configuration of the search
+void run_conform(const struct conform_conf *conf);
+
+#endif // __CONFORM
@@ -0,0 +1,457 @@
+// Multithreaded search for pairs of inputs with a fixed XOR difference whose
+// digests collide, or nearly collide
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sched.h>
+#include <math.h>
+
+#include "util.h"
+#include "algo.h"
+#include "prng.h"
+#include "channel.h"
+#include "threads.h"
+#include "diff.h"
+
+// A pair remembered in near-collision mode
+struct near_entry
+{
+    uint32_t dist;                  // Hamming distance between the digests
+    uint32_t diff;                  // Index of the difference
+    uint8_t input[MAX_BLOCK_SIZE];  // Base input; the partner is input ^ diff
+};
+
+// State owned by a single worker
+struct diff_worker
+{
+    pthread_t tid;
+    const struct diff_conf *conf;
+    struct channel *hits;           // Where pairs are sent; records are input1 || input2 || digest1 || digest2
+    uint64_t *issued;               // Shared count of base inputs handed out so far
+    uint32_t *best;                 // Shared closest distance seen so far, in near-collision mode
+    struct prng rng;                // This worker's PRNG stream
+    uint64_t pairs;                 // How many base inputs have been tried; read by the writer
+    uint64_t *counts;               // Collisions found for each difference; read after the workers are joined
+    uint64_t *survived;             // Pairs which followed the characteristic for exactly t rounds
+    uint64_t *hist;                 // How many pairs were found at each distance, in near-collision mode
+    struct near_entry *heap;        // Max-heap of the closest near_k pairs, by distance
+    size_t heap_len;                // How many entries of heap are in use
+    uint64_t *round_hits;           // Collisions after each round count for each difference, in sweep mode
+    uint64_t *round_dist;           // Total distance after each round count for each difference, in sweep mode
+    int done;                       // Set once the worker has finished
+    char pad[CACHE_LINE];
+};
+
+// Set by ^C; tells everybody to wrap up
+static volatile sig_atomic_t interrupted = 0;
+static void on_interrupt(int sig) { interrupted = 1; }
+
+// Pass a pair on to the writer
+static void send_pair(struct diff_worker *worker, uint8_t *hit, const uint8_t *input1, const uint8_t *input2,
+                      const uint8_t *digest1, const uint8_t *digest2)
+{
+    const size_t blk = worker->conf->algo->blk_size, dig = worker->conf->algo->dig_size;
+    memcpy(hit,                 input1,  blk);
+    memcpy(hit + blk,           input2,  blk);
+    memcpy(hit + 2 * blk,       digest1, dig);
+    memcpy(hit + 2 * blk + dig, digest2, dig);
+    // The channel only fills up if the writer falls far behind
+    while (!channel_try_push(worker->hits, hit) && !interrupted) sched_yield();
+}
+
+// Offer a pair to a worker's heap of its closest pairs
+static void near_offer(struct diff_worker *worker, uint32_t dist, uint32_t d, const uint8_t *input)
+{
+    struct near_entry *heap = worker->heap;
+    size_t idx;
+    if (worker->heap_len < worker->conf->near_k)
+    {
+        // Room to spare; sift the new entry up from the bottom
+        idx = worker->heap_len++;
+        while (idx && heap[(idx - 1) / 2].dist < dist)
+        {
+            heap[idx] = heap[(idx - 1) / 2];
+            idx = (idx - 1) / 2;
+        }
+    }
+    else if (dist < heap[0].dist)
+    {
+        // Replace the furthest pair; sift the new entry down from the top
+        idx = 0;
+        while (1)
+        {
+            size_t child = 2 * idx + 1;
+            if (child >= worker->heap_len) break;
+            if (child + 1 < worker->heap_len && heap[child + 1].dist > heap[child].dist) child++;
+            if (heap[child].dist <= dist) break;
+            heap[idx] = heap[child];
+            idx = child;
+        }
+    }
+    else return;
+    heap[idx].dist = dist;
+    heap[idx].diff = d;
+    memcpy(heap[idx].input, input, worker->conf->algo->blk_size);
+}
+
+// Score a pair in near-collision mode
+static inline void near_check(struct diff_worker *worker, size_t d, uint8_t *hit, const uint8_t *input1,
+                              const uint8_t *input2, const uint8_t *digest1, const uint8_t *digest2)
+{
+    const size_t dig = worker->conf->algo->dig_size;
+    uint32_t dist = digest_distance(digest1, digest2, dig);
+    worker->hist[dist]++;
+    if (!dist) worker->counts[d]++;
+    if (worker->heap_len == worker->conf->near_k && dist >= worker->heap[0].dist) return;
+    near_offer(worker, dist, d, input1);
+
+    // Print every pair which is closer than anything seen so far by any worker
+    uint32_t best = __atomic_load_n(worker->best, __ATOMIC_RELAXED);
+    while (dist < best)
+    {
+        if (__atomic_compare_exchange_n(worker->best, &best, dist, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        {
+            send_pair(worker, hit, input1, input2, digest1, digest2);
+            break;
+        }
+    }
+}
+
+// Compare a pair's digests, recording it if it is a collision (or near-collision)
+static inline void check_pair(struct diff_worker *worker, size_t d, uint8_t *hit, const uint8_t *input1,
+                              const uint8_t *input2, const uint8_t *digest1, const uint8_t *digest2)
+{
+    if (worker->conf->near_k)
+    {
+        near_check(worker, d, hit, input1, input2, digest1, digest2);
+    }
+    else if (digest_equal(digest1, digest2, worker->conf->algo->dig_size))
+    {
+        worker->counts[d]++;
+        send_pair(worker, hit, input1, input2, digest1, digest2);
+    }
+}
+
+// Compare a batch of pairs after every round count, hashing each input only once
+static void sweep_batch(struct diff_worker *worker, const uint8_t *input1, size_t count,
+                        uint8_t *input2, uint8_t *digests1, uint8_t *digests2, uint8_t *hit)
+{
+    const struct diff_conf *conf = worker->conf;
+    const struct hash_algo *algo = conf->algo;
+    const size_t blk = algo->blk_size, dig = algo->dig_size, rounds = conf->rounds;
+
+    for (size_t idx = 0; idx < count; idx++)
+    {
+        const uint8_t *inp1 = input1 + idx * blk;
+        algo->hash_sweep(inp1, blk, rounds, NULL, digests1);
+        for (size_t d = 0; d < conf->ndiffs; d++)
+        {
+            const uint8_t *diff = conf->diffs + d * blk;
+            for (size_t i = 0; i < blk; i++) input2[i] = inp1[i] ^ diff[i];
+            algo->hash_sweep(input2, blk, rounds, NULL, digests2);
+
+            uint64_t *hits = worker->round_hits + d * rounds, *dist = worker->round_dist + d * rounds;
+            for (size_t t = 0; t < rounds; t++)
+            {
+                uint32_t delta = digest_distance(digests1 + t * dig, digests2 + t * dig, dig);
+                dist[t] += delta;
+                if (delta) continue;
+                hits[t]++;
+                // Only collisions for the full number of rounds are printed
+                if (t == rounds - 1)
+                {
+                    worker->counts[d]++;
+                    send_pair(worker, hit, inp1, input2, digests1 + t * dig, digests2 + t * dig);
+                }
+            }
+        }
+    }
+}
+
+// Worker thread; hashes batches of random base inputs until the samples run out
+static void *diff_worker_main(void *arg)
+{
+    struct diff_worker *worker = (struct diff_worker *) arg;
+    const struct diff_conf *conf = worker->conf;
+    const struct hash_algo *algo = conf->algo;
+    const size_t blk = algo->blk_size, dig = algo->dig_size;
+
+    // Sweeps keep a digest for every round count of a single input
+    const size_t ndigests = BATCH_SIZE > conf->rounds? BATCH_SIZE : conf->rounds;
+    uint8_t *input1  = malloc(BATCH_SIZE * blk),
+            *input2  = malloc(BATCH_SIZE * blk),
+            *digest1 = malloc(ndigests * dig),
+            *digest2 = malloc(ndigests * dig),
+            *hit     = malloc(2*blk + 2*dig);
+    while (!interrupted)
+    {
+        // Claim the next batch of samples
+        size_t count = BATCH_SIZE;
+        if (conf->samples)
+        {
+            uint64_t start = __atomic_fetch_add(worker->issued, BATCH_SIZE, __ATOMIC_RELAXED);
+            if (start >= conf->samples) break;
+            if (conf->samples - start < count) count = conf->samples - start;
+        }
+
+        // Every base input is hashed only once
+        prng_fill(&worker->rng, input1, count * blk);
+        if (conf->sweep)
+        {
+            sweep_batch(worker, input1, count, input2, digest1, digest2, hit);
+            __atomic_fetch_add(&worker->pairs, count, __ATOMIC_RELAXED);
+            continue;
+        }
+        if (!conf->expect) hash_many(algo, input1, count, blk, conf->rounds, digest1);
+
+        // then compared against its partner under every difference
+        for (size_t d = 0; d < conf->ndiffs; d++)
+        {
+            const uint8_t *diff = conf->diffs + d * blk;
+            for (size_t i = 0; i < count * blk; i++) input2[i] = input1[i] ^ diff[i % blk];
+
+            if (conf->expect)
+            {
+                // Run each pair in lockstep; only those which follow the
+                // whole characteristic are hashed in full
+                for (size_t idx = 0; idx < count; idx++)
+                {
+                    const uint8_t *inp1 = input1 + idx * blk, *inp2 = input2 + idx * blk;
+                    size_t t = algo->pair_check(inp1, inp2, conf->rounds, conf->expect, conf->mask);
+                    worker->survived[t]++;
+                    if (t < conf->rounds) continue;
+                    algo->hash_raw(inp1, blk, conf->rounds, digest1);
+                    algo->hash_raw(inp2, blk, conf->rounds, digest2);
+                    check_pair(worker, d, hit, inp1, inp2, digest1, digest2);
+                }
+                continue;
+            }
+
+            hash_many(algo, input2, count, blk, conf->rounds, digest2);
+            for (size_t idx = 0; idx < count; idx++)
+            {
+                check_pair(worker, d, hit, input1 + idx * blk, input2 + idx * blk, 
+                           digest1 + idx * dig, digest2 + idx * dig);
+            }
+        }
+        __atomic_fetch_add(&worker->pairs, count, __ATOMIC_RELAXED);
+    }
+    free(input1); free(input2); free(digest1); free(digest2); free(hit);
+    __atomic_store_n(&worker->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Comparator for sorting near_entry values by distance with qsort
+static int cmp_near_entry(const void *x, const void *y)
+{
+    uint32_t a = ((const struct near_entry *) x)->dist, b = ((const struct near_entry *) y)->dist;
+    return (a > b) - (a < b);
+}
+
+// Print the distance histogram and the closest pairs found by every worker
+static void near_report(const struct diff_conf *conf, struct diff_worker *workers, uint64_t samples)
+{
+    const struct hash_algo *algo = conf->algo;
+    const size_t blk = algo->blk_size, dig = algo->dig_size;
+    const uint64_t total = samples * conf->ndiffs;
+    char hashbuf[2*MAX_BLOCK_SIZE + 1];
+
+    puts("Distances:");
+    for (size_t dist = 0; dist <= 8 * dig; dist++)
+    {
+        uint64_t count = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++) count += workers[idx].hist[dist];
+        if (!count) continue;
+        printf("%3zu : %llu/%llu (2^%.3f)\n", dist, (unsigned long long) count, (unsigned long long) total,
+               log2((double) count) - log2((double) total));
+    }
+
+    // Merge every worker's heap, and keep the closest near_k overall
+    size_t len = 0;
+    struct near_entry *all = calloc(conf->nthreads * conf->near_k, sizeof(struct near_entry));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        memcpy(all + len, workers[idx].heap, workers[idx].heap_len * sizeof(struct near_entry));
+        len += workers[idx].heap_len;
+    }
+    qsort(all, len, sizeof(struct near_entry), cmp_near_entry);
+    if (len > conf->near_k) len = conf->near_k;
+
+    puts("Closest pairs:");
+    uint8_t partner[MAX_BLOCK_SIZE], digest1[MAX_BLOCK_SIZE], digest2[MAX_BLOCK_SIZE];
+    for (size_t idx = 0; idx < len; idx++)
+    {
+        const uint8_t *diff = conf->diffs + all[idx].diff * blk;
+        for (size_t i = 0; i < blk; i++) partner[i] = all[idx].input[i] ^ diff[i];
+        algo->hash_raw(all[idx].input, blk, conf->rounds, digest1);
+        algo->hash_raw(partner, blk, conf->rounds, digest2);
+        printf("%s - ", to_hex(all[idx].input, blk, hashbuf));
+        printf("%s => ", to_hex(partner, blk, hashbuf));
+        printf("%s ", to_hex(digest1, dig, hashbuf));
+        printf("%s (distance %u)\n", to_hex(digest2, dig, hashbuf), all[idx].dist);
+    }
+    free(all);
+}
+
+// Print the collisions and mean distance of every difference after each round count
+static void sweep_report(const struct diff_conf *conf, struct diff_worker *workers, uint64_t samples)
+{
+    const size_t blk = conf->algo->blk_size;
+    char hashbuf[2*MAX_BLOCK_SIZE + 1];
+
+    for (size_t d = 0; d < conf->ndiffs; d++)
+    {
+        printf("0x%s:\n", to_hex(conf->diffs + d * blk, blk, hashbuf));
+        for (size_t t = 0; t < conf->rounds; t++)
+        {
+            uint64_t hits = 0, dist = 0;
+            for (size_t idx = 0; idx < conf->nthreads; idx++)
+            {
+                hits += workers[idx].round_hits[d * conf->rounds + t];
+                dist += workers[idx].round_dist[d * conf->rounds + t];
+            }
+            printf("  Round %zu: %llu/%llu", t + 1, (unsigned long long) hits, (unsigned long long) samples);
+            if (hits) printf(" (2^%.3f)", log2((double) hits) - log2((double) samples));
+            else      printf(" (0)");
+            printf(", mean distance %.3f\n", samples? (double) dist / samples : 0.0);
+        }
+    }
+}
+
+// Search for colliding pairs
+void run_diff(const struct diff_conf *conf)
+{
+    const struct hash_algo *algo = conf->algo;
+    const size_t blk = algo->blk_size, dig = algo->dig_size;
+    struct channel *hits = channel_new(4096, 2*blk + 2*dig);
+    signal(SIGINT, on_interrupt);
+
+    // Give every worker its own non-overlapping PRNG stream
+    struct prng rng;
+    prng_seed(&rng, conf->seed);
+    uint64_t issued = 0;
+    uint32_t best = 8 * dig + 1;
+    struct diff_worker *workers = calloc(conf->nthreads, sizeof(struct diff_worker));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        workers[idx].conf     = conf;
+        workers[idx].hits     = hits;
+        workers[idx].issued   = &issued;
+        workers[idx].rng      = rng;
+        workers[idx].counts   = calloc(conf->ndiffs, sizeof(uint64_t));
+        workers[idx].survived = calloc(conf->rounds + 1, sizeof(uint64_t));
+        workers[idx].best     = &best;
+        workers[idx].hist     = calloc(8 * dig + 1, sizeof(uint64_t));
+        workers[idx].heap     = calloc(conf->near_k + 1, sizeof(struct near_entry));
+        workers[idx].round_hits = calloc(conf->ndiffs * conf->rounds, sizeof(uint64_t));
+        workers[idx].round_dist = calloc(conf->ndiffs * conf->rounds, sizeof(uint64_t));
+        prng_jump(&rng);
+        pthread_create(&workers[idx].tid, NULL, diff_worker_main, &workers[idx]);
+    }
+
+    // Act as the single writer: print collisions as they come in, and report progress
+    uint8_t *hit = malloc(2*blk + 2*dig);
+    char *hashbuf = malloc(2*MAX_BLOCK_SIZE + 1);
+    uint64_t collisions = 0, last_pairs = 0;
+    double last = now_seconds();
+    while (1)
+    {
+        // Check whether everybody has finished before draining, so no collision is missed
+        size_t finished = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++)
+            finished += __atomic_load_n(&workers[idx].done, __ATOMIC_ACQUIRE);
+
+        bool idle = true;
+        while (channel_try_pop(hits, hit))
+        {
+            printf("%s - ", to_hex(hit, blk, hashbuf));
+            printf("%s => ", to_hex(hit + blk, blk, hashbuf));
+            if (conf->near_k)
+            {
+                printf("%s ", to_hex(hit + 2*blk, dig, hashbuf));
+                printf("%s (distance %u)\n", to_hex(hit + 2*blk + dig, dig, hashbuf),
+                       digest_distance(hit + 2*blk, hit + 2*blk + dig, dig));
+            }
+            else printf("%s\n", to_hex(hit + 2*blk, dig, hashbuf));
+            collisions++;
+            idle = false;
+        }
+        if (!idle) fflush(stdout);
+        if (finished == conf->nthreads) break;
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            uint64_t pairs = 0;
+            for (size_t idx = 0; idx < conf->nthreads; idx++)
+                pairs += __atomic_load_n(&workers[idx].pairs, __ATOMIC_RELAXED);
+            pairs *= conf->ndiffs;
+            if (conf->near_k)
+            {
+                log_line(stderr, "%llu pairs (%.3e/s), closest distance %u",
+                         (unsigned long long) pairs, (pairs - last_pairs) / (now - last),
+                         __atomic_load_n(&best, __ATOMIC_RELAXED));
+            }
+            else
+            {
+                log_line(stderr, "%llu pairs (%.3e/s), %llu collisions",
+                         (unsigned long long) pairs, (pairs - last_pairs) / (now - last),
+                         (unsigned long long) collisions);
+            }
+            last_pairs = pairs;
+            last = now;
+        }
+        if (idle) sleep_ms(1);
+    }
+
+    // Report the hit count and empirical probability of every difference
+    uint64_t samples = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_join(workers[idx].tid, NULL);
+        samples += workers[idx].pairs;
+    }
+    printf("Samples: %llu\n", (unsigned long long) samples);
+    for (size_t d = 0; d < conf->ndiffs; d++)
+    {
+        uint64_t count = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++) count += workers[idx].counts[d];
+        printf("0x%s : %llu/%llu", to_hex(conf->diffs + d * blk, blk, hashbuf),
+               (unsigned long long) count, (unsigned long long) samples);
+        if (count) printf(" (2^%.3f)\n", log2((double) count) - log2((double) samples));
+        else       printf(" (0)\n");
+    }
+    if (conf->expect)
+    {
+        // Pairs which made it through round t are those which survived for more than t rounds
+        uint64_t total = samples * conf->ndiffs, remaining = total;
+        for (size_t t = 0; t < conf->rounds; t++)
+        {
+            for (size_t idx = 0; idx < conf->nthreads; idx++) remaining -= workers[idx].survived[t];
+            printf("Round %zu: %llu/%llu", t + 1, (unsigned long long) remaining, (unsigned long long) total);
+            if (remaining) printf(" (2^%.3f)\n", log2((double) remaining) - log2((double) total));
+            else           printf(" (0)\n");
+        }
+    }
+    if (conf->near_k) near_report(conf, workers, samples);
+    if (conf->sweep) sweep_report(conf, workers, samples);
+    fflush(stdout);
+
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        free(workers[idx].counts);
+        free(workers[idx].survived);
+        free(workers[idx].hist);
+        free(workers[idx].heap);
+        free(workers[idx].round_hits);
+        free(workers[idx].round_dist);
+    }
+    free(workers);
+    free(hit);
+    free(hashbuf);
+    channel_free(hits);
+}
@@ -0,0 +1,51 @@
+// Multithreaded search for pairs of inputs with a fixed XOR difference whose
+// digests collide
+
+#ifndef __DIFF
+#define __DIFF
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "algo.h"
+
+// Configuration of a differential collision search
+struct diff_conf
+{
+    const struct hash_algo *algo;   // Algorithm being attacked
+    size_t rounds;                  // How many rounds of the algorithm to run
+    const uint8_t *diffs;           // XOR differences; ndiffs blocks of algo->blk_size bytes
+    size_t ndiffs;                  // How many differences are being tested
+    const uint8_t *expect;          // Expected register difference after each round; NULL to skip
+    const uint8_t *mask;            // Bits of expect which must match after each round
+    size_t near_k;                  // If nonzero, track the near_k closest pairs instead of collisions
+    bool sweep;                     // Compare pairs after every round count up to rounds
+    uint64_t samples;               // How many base inputs to sample; 0 samples forever
+    size_t nthreads;                // How many worker threads to run
+    uint64_t seed;                  // Seed for the workers' PRNG streams
+};
+
+// Search for colliding pairs. Every worker draws single-block base inputs x
+// from its own PRNG stream, hashes each one once, and compares it against
+// x ^ d for every difference d. If a characteristic is given, each pair is
+// instead run through the compression in lockstep and abandoned as soon as
+// it leaves the characteristic; only conforming pairs are hashed in full.
+// Collisions are sent to the calling thread,
+// which prints them to stdout and reports progress to stderr. Once every
+// sample has been taken, or the search is interrupted with ^C, the hit count
+// and empirical probability of each difference is printed to stdout, along
+// with how many pairs followed the characteristic through each round.
+//
+// In near-collision mode, every pair is scored by the Hamming distance between
+// its digests instead. Each worker keeps a histogram of the distances and a
+// heap of its closest pairs. Every pair which beats the closest distance seen
+// so far is printed as it is found, and the histogram and the closest pairs
+// overall are printed at the end.
+//
+// In sweep mode, each input is hashed for every round count from 1 to rounds
+// in one pass with hash_sweep, and the collision count and mean distance
+// between the digests of each difference are printed for every round count.
+// Params:
+// - conf: Configuration of the search
+void run_diff(const struct diff_conf *conf);
+
+#endif // __DIFF
@@ -0,0 +1,136 @@
+// Multithreaded hashing of whole files
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "algo.h"
+#include "channel.h"
+#include "threads.h"
+#include "files.h"
+
+// Outcome of hashing a single file
+struct file_result
+{
+    uint8_t digest[MAX_BLOCK_SIZE]; // Raw digest, if err is 0
+    int err;                        // errno of whatever went wrong, or 0
+    int done;                       // Set once the result is ready
+};
+
+// State shared by every worker
+struct files_state
+{
+    const struct files_conf *conf;
+    struct file_result *results;    // One per path, in order
+    char pad0[CACHE_LINE];
+    size_t claimed;                 // Next file to be claimed by a worker
+    char pad1[CACHE_LINE];
+};
+
+// Feed everything readable from fd into ctx through buf
+// Returns: 0, or the errno of a failed read
+static int hash_reads(const struct hash_algo *algo, void *ctx, int fd, uint8_t *buf)
+{
+    while (1)
+    {
+        ssize_t got = read(fd, buf, FILES_BUFFER);
+        if (got < 0 && errno == EINTR) continue;
+        if (got < 0) return errno;
+        if (got == 0) return 0;
+        algo->update(ctx, buf, got);
+    }
+}
+
+// Hash a single file into digest
+// Returns: 0, or the errno of whatever went wrong
+static int hash_file(const struct files_conf *conf, const char *path, void *ctx, uint8_t *buf, uint8_t *digest)
+{
+    const struct hash_algo *algo = conf->algo;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return errno;
+
+    int err = 0;
+    struct stat st;
+    algo->init(ctx, conf->rounds);
+    if (fstat(fd, &st) < 0) err = errno;
+    else if (S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            // The whole file is read front to back exactly once
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            algo->update(ctx, map, st.st_size);
+            munmap(map, st.st_size);
+        }
+        else err = hash_reads(algo, ctx, fd, buf);
+    }
+    else err = hash_reads(algo, ctx, fd, buf);
+    close(fd);
+
+    if (!err) algo->final(ctx, digest);
+    return err;
+}
+
+// Worker thread; claims files in turn until there are none left
+static void *files_worker_main(void *arg)
+{
+    struct files_state *state = (struct files_state *) arg;
+    const struct files_conf *conf = state->conf;
+
+    void *ctx = malloc(conf->algo->ctx_size), *buf = NULL;
+    if (posix_memalign(&buf, 4096, FILES_BUFFER)) buf = malloc(FILES_BUFFER);
+    while (1)
+    {
+        size_t idx = __atomic_fetch_add(&state->claimed, 1, __ATOMIC_RELAXED);
+        if (idx >= conf->npaths) break;
+        struct file_result *result = &state->results[idx];
+        result->err = hash_file(conf, conf->paths[idx], ctx, buf, result->digest);
+        __atomic_store_n(&result->done, 1, __ATOMIC_RELEASE);
+    }
+    free(ctx);
+    free(buf);
+    return NULL;
+}
+
+// Hash every file, printing the results in order
+size_t run_files(const struct files_conf *conf)
+{
+    struct files_state state = { conf };
+    state.results = calloc(conf->npaths, sizeof(struct file_result));
+
+    pthread_t *tids = calloc(conf->nthreads, sizeof(pthread_t));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_create(&tids[idx], NULL, files_worker_main, &state);
+    }
+
+    // Print each result as soon as it and every one before it are ready
+    size_t failed = 0;
+    char hashbuf[2*MAX_BLOCK_SIZE + 1];
+    for (size_t idx = 0; idx < conf->npaths; idx++)
+    {
+        struct file_result *result = &state.results[idx];
+        while (!__atomic_load_n(&result->done, __ATOMIC_ACQUIRE)) sleep_ms(1);
+        if (result->err)
+        {
+            fflush(stdout);
+            fprintf(stderr, "%s: %s\n", conf->paths[idx], strerror(result->err));
+            failed++;
+            continue;
+        }
+        printf("%s - %s\n", to_hex(result->digest, conf->algo->dig_size, hashbuf), conf->paths[idx]);
+    }
+    fflush(stdout);
+
+    for (size_t idx = 0; idx < conf->nthreads; idx++) pthread_join(tids[idx], NULL);
+    free(tids);
+    free(state.results);
+    return failed;
+}
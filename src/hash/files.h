@@ -0,0 +1,33 @@
+// Multithreaded hashing of whole files
+
+#ifndef __FILES
+#define __FILES
+
+#include <stddef.h>
+#include "algo.h"
+
+// Size of the buffer used for files which cannot be memory-mapped
+#define FILES_BUFFER (1 << 20)
+
+// Configuration of a file hashing run
+struct files_conf
+{
+    const struct hash_algo *algo;   // Algorithm being run
+    size_t rounds;                  // How many rounds of the algorithm to run
+    char **paths;                   // Files to hash
+    size_t npaths;                  // How many files there are
+    size_t nthreads;                // How many worker threads to run
+};
+
+// Hash every file in paths. Workers claim files in turn, memory-map each one
+// and feed it through the algorithm's streaming context; anything which
+// cannot be mapped, such as a pipe, is read through a large aligned buffer
+// instead. The calling thread prints "digest - path" for every file to
+// stdout in the order they were given, as soon as each is ready. Files which
+// cannot be read are reported to stderr.
+// Params:
+// - conf: Configuration of the run
+// Returns: The number of files which could not be hashed
+size_t run_files(const struct files_conf *conf);
+
+#endif // __FILES
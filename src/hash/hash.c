@@ -4,55 +4,183 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 #include "sha2.h"
 #include "maw32.h"
-
-// Description of a hash algorithm
-struct hash_algo
-{
-    char *name;         // Name (lowercase)
-    size_t blk_size;    // Block size in bytes
-    size_t dig_size;    // Digest size in bytes
-    char *(*hash)(const uint8_t *, size_t, size_t, char *); // Pointer to the function
-};
-
-// Const array of supported hash functions
-static const struct hash_algo known_algos[] = 
-{
-    { "maw32", 8, 4, maw32_hash },
-    { "sha256", 64, 32, sha256_hash },
-};
-#define LEN(_arr) (sizeof(_arr)/sizeof((_arr)[0]))
+#include "algo.h"
+#include "algos.h"
+#include "threads.h"
+#include "diff.h"
+#include "stats.h"
+#include "avalanche.h"
+#include "iterate.h"
+#include "records.h"
+#include "writer.h"
+#include "prng.h"
+#include "files.h"
+#include "batch.h"
+#include "rho.h"
+#include "census.h"
+#include "preimage.h"
+#include "rainbow.h"
+#include "birthday.h"
+#include "conform.h"
 
 // Mutate a string in-place, making it lowercase
-inline char *to_lower_str(char *str)
+static inline char *to_lower_str(char *str)
 {
     for (char *sent = str; *sent; sent++) if (*sent >= 'A' && *sent <= 'Z') *sent += 'a' - 'A';
     return str;
 }
 
 // Determine if the given string is a decimal string
-inline bool is_digit_str(char *str)
+static inline bool is_digit_str(char *str)
 {
     for (char *sent = str; *sent; sent++) if (*sent < '0' || *sent > '9') return false;
     return true;
 }
 
 // Parse a hex byte
-inline bool parse_uint8(char *str, uint8_t *result)
+static inline bool parse_uint8(char *str, uint8_t *result)
 {
     return sscanf(str, "%02hhX", result);
 }
 
 // Parse an integer, first checking that it indeed is an integer string
-inline bool parse_uint32(char *str, uint32_t *result)
+static inline bool parse_uint32(char *str, uint32_t *result)
 {
     if (!is_digit_str(str)) return false;
     *result = atoi(str);
     return true;
 }
 
+// Parse a 64-bit integer, first checking that it indeed is an integer string
+static inline bool parse_uint64(char *str, uint64_t *result)
+{
+    if (!is_digit_str(str) || !*str) return false;
+    *result = strtoull(str, NULL, 10);
+    return true;
+}
+
+// Parse a hexadecimal value of the form 0x..., exactly len bytes long
+static inline bool parse_hex(char *str, uint8_t *result, size_t len)
+{
+    if (str[0] != '0' || (str[1] != 'x' && str[1] != 'X') || strlen(str) != 2*len + 2) return false;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (!parse_uint8(str + 2*(i+1), result+i)) return false;
+    }
+    return true;
+}
+
+// Read a differential characteristic from fname: one line per round, holding
+// the expected difference in the registers after that round as a hex value,
+// optionally followed by a hex mask of the bits which must match. A line of *
+// leaves that round unchecked. Returns false, having printed why, on failure
+static bool read_characteristic(const char *fname, const struct hash_algo *algo, size_t rounds,
+                                uint8_t *expect, uint8_t *mask)
+{
+    FILE *file = fopen(fname, "r");
+    if (!file)
+    {
+        printf("Unable to open file %s\n", fname);
+        return false;
+    }
+    memset(expect, 0, rounds * algo->state_size);
+    memset(mask,   0, rounds * algo->state_size);
+
+    char *buf = NULL;
+    size_t buf_len = 0, t = 0;
+    bool ok = true;
+    while (ok && getline(&buf, &buf_len, file) != -1)
+    {
+        // Split the line into words, skipping blank lines and comments
+        char *words[2] = { NULL, NULL };
+        int nwords = 0;
+        for (char *word = strtok(buf, " \t\r\n"); word; word = strtok(NULL, " \t\r\n"))
+        {
+            if (nwords < 2) words[nwords] = word;
+            nwords++;
+        }
+        if (!nwords || words[0][0] == '#') continue;
+
+        if (t >= rounds)
+        {
+            printf("Characteristic has more than %zu rounds\n", rounds);
+            ok = false;
+        }
+        else if (nwords > 2)
+        {
+            printf("Too many values for round %zu of the characteristic\n", t + 1);
+            ok = false;
+        }
+        else if (strcmp(words[0], "*"))
+        {
+            uint8_t *e = expect + t * algo->state_size, *m = mask + t * algo->state_size;
+            if (!parse_hex(words[0], e, algo->state_size) ||
+                (words[1] && !parse_hex(words[1], m, algo->state_size)))
+            {
+                printf("Could not parse round %zu of the characteristic; expected %zu hex bytes\n",
+                       t + 1, algo->state_size);
+                ok = false;
+            }
+            else if (!words[1]) memset(m, 0xff, algo->state_size);
+        }
+        t++;
+    }
+    free(buf);
+    fclose(file);
+    return ok;
+}
+
+// Comparator for sorting uint32_t values with qsort
+static int cmp_uint32(const void *x, const void *y)
+{
+    uint32_t a = *(const uint32_t *) x, b = *(const uint32_t *) y;
+    return (a > b) - (a < b);
+}
+
+// Read one hex value of len bytes from the start of every non-blank line of
+// fname into a growing buffer. The 0x prefix is optional, so that digests as
+// printed by iterate, preimage and lookup can be used directly. Returns the
+// buffer, setting *count, or NULL, having printed why, on failure
+static uint8_t *read_hex_lines(const char *fname, size_t len, size_t *count)
+{
+    FILE *file = fopen(fname, "r");
+    if (!file)
+    {
+        printf("Unable to open file %s\n", fname);
+        return NULL;
+    }
+
+    char *buf = NULL;
+    size_t buf_len = 0, cap = 16;
+    uint8_t *values = malloc(cap * len);
+    *count = 0;
+    while (getline(&buf, &buf_len, file) != -1)
+    {
+        char *line = buf + strspn(buf, " \t");
+        line[strcspn(line, " \t\r\n")] = '\0';
+        if (!*line) continue;
+        if (*count == cap) values = realloc(values, (cap *= 2) * len);
+        if (line[0] == '0' && (line[1] == 'x' || line[1] == 'X')) line += 2;
+        bool valid = strlen(line) == 2*len;
+        for (size_t i = 0; valid && i < len; i++) valid = parse_uint8(line + 2*i, values + *count * len + i);
+        if (!valid)
+        {
+            printf("Could not parse \"%s\"; expected %zu hex bytes\n", line, len);
+            free(values);
+            values = NULL;
+            break;
+        }
+        (*count)++;
+    }
+    free(buf);
+    fclose(file);
+    return values;
+}
+
 // Show the usage for the program
 void show_usage()
 {
@@ -63,27 +191,160 @@ void show_usage()
         "  sample (ALGO, min, max, n):\n"  
         "    Randomly sample n bytestrings of length [min, max] inclusive\n"
         "    and compute the ALGO hash of these strings. Statistical\n"
-        "    information about ALGO is collected from the results.\n"
+        "    information about ALGO is collected from the results. With\n"
+        "    -s, the statistics are gathered in-process and only they are\n"
+        "    printed: the bias of every digest bit, a chi-square statistic\n"
+        "    of each digest byte, digest collisions, and the same results\n"
+        "    for buckets of input lengths.\n"
         "  iterate (ALGO, n):\n"
         "    Iterate through every bytestring of length n, and compute\n"
-        "    the ALGO hash of these strings.\n"
+        "    the ALGO hash of these strings. The strings are split into\n"
+        "    chunks which are hashed by -j worker threads, and printed in\n"
+        "    order unless -u is given.\n"
         "  test (ALGO, inp...):\n"
         "    Compute the ALGO hash of every input given in inp..., in order.\n"
         "    The hashes are presented on different lines along with\n"
         "    their inputs.\n"
-        "  diff (ALGO, rounds, diff):\n"
+        "  file (ALGO, path...):\n"
+        "    Compute the ALGO hash of the contents of every file in path...\n"
+        "    Files are memory-mapped and hashed by -j worker threads, and\n"
+        "    printed in the order they were given.\n"
+        "  batch (ALGO):\n"
+        "    Compute the ALGO hash of every message read from stdin, one\n"
+        "    message per line, or length-prefixed with -l. The messages\n"
+        "    are hashed in batches by -j worker threads, and one digest\n"
+        "    per message is printed in order; raw digests are written\n"
+        "    with -b.\n"
+        "  diff (ALGO, rounds, diff...):\n"
         "    Randomly sample inputs, and determine if the input XOR the diff\n"
         "    results in a collision after a given number of rounds.\n"
-        "    diff should be expressed as a single hexadecimal value\n"
+        "    diff should be expressed as a single hexadecimal value. Any\n"
+        "    number of diffs may be given; each sampled input is hashed\n"
+        "    once and compared against its partner under every diff. A\n"
+        "    diff of the form @file reads one diff per line from file.\n"
+        "    The hits and probability of each diff are printed at the end.\n"
+        "    With -c, pairs are checked against a characteristic after\n"
+        "    every round, and abandoned as soon as they leave it.\n"
+        "  near (ALGO, rounds, diff...):\n"
+        "    As diff, but score every pair by the number of bits in which\n"
+        "    the digests differ. Each new closest pair is printed as it is\n"
+        "    found; a histogram of distances and the closest pairs overall\n"
+        "    are printed at the end.\n"
+        "  sweep (ALGO, rounds, diff...):\n"
+        "    As diff, but hash each pair for every round count from 1 to\n"
+        "    rounds in a single pass. The collisions and mean number of\n"
+        "    differing digest bits of each diff are printed for every\n"
+        "    round count at the end.\n"
+        "  rho (ALGO, rounds, bits):\n"
+        "    Search for pairs of messages whose digests agree in their\n"
+        "    leading bits, with parallel Pollard rho and distinguished\n"
+        "    points. Each message is a point of bits bits, and is hashed\n"
+        "    to give the next point. Each collision is printed as it is\n"
+        "    found, and the search stops after -n collisions, 1 if not\n"
+        "    given. bits is at most 63, and at most the digest size.\n"
+        "  conform (ALGO, rounds, diff):\n"
+        "    Search for single-block pairs x, x ^ diff which follow the\n"
+        "    characteristic given with -c through rounds rounds. Message\n"
+        "    bytes are fixed one round at a time, only keeping the values\n"
+        "    which satisfy that round, and the remaining rounds are checked\n"
+        "    as soon as the block is complete. Each pair is printed with\n"
+        "    its digests as it is found, and the search stops after -n\n"
+        "    pairs, 1 if not given, or once every message has been tried.\n"
+        "    Only supports maw32.\n"
+        "  census (ALGO, rounds, prefix, n):\n"
+        "    Hash every input made of the hex prefix (0x for none) followed\n"
+        "    by each n-byte suffix, where n is at most 4, and count how\n"
+        "    often the leading 32 bits of each digest are hit. The number\n"
+        "    of digests hit k times is printed for every k, next to what a\n"
+        "    random function would give, along with the colliding pairs.\n"
+        "    With -m, the inputs of frequent digests are also listed.\n"
+        "    Needs a little over 2 GiB of memory.\n"
+        "  preimage (ALGO, rounds, targets, n):\n"
+        "    Hash every bytestring of length n, as iterate does, and print\n"
+        "    each one whose digest is in the file targets, which holds one\n"
+        "    hex digest per line, with or without 0x. The strings are split\n"
+        "    into chunks which are hashed by -j worker threads; --start and\n"
+        "    --end narrow the range. The number of targets found is printed\n"
+        "    at the end.\n"
+        "  rainbow (ALGO, rounds, n, chains, length, file):\n"
+        "    Build a rainbow table in file for inverting digests of n-byte\n"
+        "    inputs, where n is at most 4, made of chains of length steps.\n"
+        "    The chains are built by -j worker threads. If the build is\n"
+        "    interrupted, running it again carries on where it stopped.\n"
+        "  lookup (ALGO, file, targets):\n"
+        "    Search the rainbow table in file for preimages of every digest\n"
+        "    in the file targets, which holds one hex digest per line, with\n"
+        "    or without 0x, using -j worker threads.\n"
+        "  birthday (ALGO, rounds, bits, n):\n"
+        "    Hash n distinct random 8-byte messages, and print every pair\n"
+        "    whose digests agree in their leading bits, for bits up to 64.\n"
+        "    Digest prefixes are sorted in runs on disk and merged, so\n"
+        "    memory use stays within --mem however large n is.\n"
+        "  avalanche (ALGO, rounds, n):\n"
+        "    Sample n random single-block messages, and flip every input\n"
+        "    bit of each in turn. The probability that each output bit\n"
+        "    flips is printed as a matrix, one row per input bit, along\n"
+        "    with how far it strays from 1/2.\n"
         "  help ():\n"
         "    Show this message\n" 
         "\n"
+        "FLAGS (may appear anywhere after ALGO):\n"
+        "  -j n:\n"
+        "    Use n worker threads for iterate, file, batch, diff, rho,\n"
+        "    conform, census, preimage, rainbow, lookup, birthday,\n"
+        "    sample -s and avalanche; 0 uses one per core. Defaults to 1.\n"
+        "  -c file:\n"
+        "    Check diff or conform pairs against the characteristic in\n"
+        "    file, which has one line per round: the expected XOR\n"
+        "    difference of the registers after that round (a,b,c,d for\n"
+        "    maw32; a..h for sha256) in hex, optionally followed by a hex\n"
+        "    mask of the bits which must match. A line of * skips that\n"
+        "    round.\n"
+        "  -n count:\n"
+        "    Stop diff after sampling count inputs. Defaults to 0, which\n"
+        "    samples until interrupted with ^C. Stop rho after finding\n"
+        "    count collisions, and conform after finding count pairs.\n"
+        "  --seed s:\n"
+        "    Seed the generator of random inputs for sample, diff, near,\n"
+        "    sweep, rho, conform, birthday and avalanche with s, to\n"
+        "    reproduce an earlier run. The seed is printed to stderr;\n"
+        "    defaults to the current time.\n"
+        "  -u:\n"
+        "    Print iterate results as each chunk finishes, rather than in\n"
+        "    order.\n"
+        "  --start i, --end j:\n"
+        "    Only iterate or try as preimages the inputs with indices in\n"
+        "    [i, j), where input i is i as a big-endian integer. Defaults\n"
+        "    to every input.\n"
+        "  -b:\n"
+        "    Write sample and iterate results as binary records rather\n"
+        "    than text: a 64-byte header, then for every input its length\n"
+        "    as a little-endian 32-bit int, the input zero-padded to the\n"
+        "    longest length, and the raw digest. For batch, write only\n"
+        "    the raw digests, back-to-back.\n"
+        "  -l:\n"
+        "    Read batch messages as a little-endian 32-bit length followed\n"
+        "    by that many bytes, rather than one per line.\n"
+        "  -s:\n"
+        "    Print statistics from sample instead of every hash.\n"
+        "  -k count:\n"
+        "    Keep the count closest pairs found by near. Defaults to 16.\n"
+        "  -m min:\n"
+        "    After a census, list \"digest - input\" for every input whose\n"
+        "    digest was hit at least min times, sorted by digest.\n"
+        "  --mem MiB:\n"
+        "    Buffer at most MiB mebibytes of birthday records in memory.\n"
+        "    Defaults to 256.\n"
+        "  --tmp dir:\n"
+        "    Write the sorted runs of birthday to dir. Defaults to\n"
+        "    $TMPDIR, or /tmp.\n"
+        "\n"
         "ALGO:");
     printf("  ");
-    for (int i = 0; i < LEN(known_algos); i++)
+    for (int i = 0; i < num_known_algos; i++)
     {
         printf("%s", known_algos[i].name);
-        if (i != LEN(known_algos)-1) printf(", ");
+        if (i != num_known_algos-1) printf(", ");
     }
     putchar('\n');
 }
@@ -102,8 +363,6 @@ int main(int argc, char **argv)
 
     // Need at least 2 arguments: { "hash", "[OPT]", ... }
     ASSERT(argc >= 2);
-    // Seed the PRNG
-    srand(time(NULL));
 
     // Get the option
     char *opt  = to_lower_str(argv[1]);
@@ -114,20 +373,110 @@ int main(int argc, char **argv)
     ASSERT(argc >= 3, puts("Missing hash function"));
     to_lower_str(argv[2]);
     char hashbuf[256];
-    struct hash_algo algo = { NULL, -1, -1, NULL };
+    uint8_t digest[128];
+    struct hash_algo algo = { NULL };
     to_lower_str(argv[2]);
-    for (int i = 0; i < LEN(known_algos); i++) if (!strcmp(argv[2], known_algos[i].name))
+    for (int i = 0; i < num_known_algos; i++) if (!strcmp(argv[2], known_algos[i].name))
     {
         algo = known_algos[i];
         break;
     }
     ASSERT(algo.hash, printf("Unknown hash function '%s'\n", argv[2]));
+    // Report which implementations were picked for this CPU; stderr keeps this out of the results
+    fprintf(stderr, "%s backend: %s (single), %s (batch)\n", algo.name,
+            algo.backend? algo.backend() : "scalar",
+            algo.many_backend? algo.many_backend() : "single");
 
     // We no longer need to access argv[0] (fname), argv[1] (opt), or argv[2] (algo)
     // Shuffle along to make later logic simpler
     argv += 3;
     argc -= 3;
 
+    // Pull any flags out of the remaining arguments, leaving only the positional ones
+    size_t nthreads = 1;
+    uint32_t samples = 0, closest = 16, list_min = 0, memory = 256;
+    char *tmpdir = getenv("TMPDIR")? getenv("TMPDIR") : "/tmp";
+    char *characteristic = NULL;
+    bool stats = false, ordered = true, has_end = false, binary = false, prefixed = false;
+    uint64_t start = 0, end = 0, seed = time(NULL);
+    {
+        int kept = 0;
+        for (int idx = 0; idx < argc; idx++)
+        {
+            if (!strcmp(argv[idx], "-j"))
+            {
+                uint32_t j;
+                ASSERT(idx + 1 < argc && parse_uint32(argv[idx+1], &j), puts("Flag '-j' requires an integer"));
+                nthreads = j? j : num_cores();
+                idx++;
+            }
+            else if (!strcmp(argv[idx], "-c"))
+            {
+                ASSERT(idx + 1 < argc, puts("Flag '-c' requires a file"));
+                characteristic = argv[++idx];
+            }
+            else if (!strcmp(argv[idx], "-n"))
+            {
+                ASSERT(idx + 1 < argc && parse_uint32(argv[idx+1], &samples), puts("Flag '-n' requires an integer"));
+                idx++;
+            }
+            else if (!strcmp(argv[idx], "-s")) stats = true;
+            else if (!strcmp(argv[idx], "-u")) ordered = false;
+            else if (!strcmp(argv[idx], "-b")) binary = true;
+            else if (!strcmp(argv[idx], "-l")) prefixed = true;
+            else if (!strcmp(argv[idx], "--seed"))
+            {
+                ASSERT(idx + 1 < argc && parse_uint64(argv[idx+1], &seed), puts("Flag '--seed' requires an integer"));
+                idx++;
+            }
+            else if (!strcmp(argv[idx], "--start"))
+            {
+                ASSERT(idx + 1 < argc && parse_uint64(argv[idx+1], &start), puts("Flag '--start' requires an integer"));
+                idx++;
+            }
+            else if (!strcmp(argv[idx], "--end"))
+            {
+                ASSERT(idx + 1 < argc && parse_uint64(argv[idx+1], &end), puts("Flag '--end' requires an integer"));
+                has_end = true;
+                idx++;
+            }
+            else if (!strcmp(argv[idx], "-k"))
+            {
+                ASSERT(idx + 1 < argc && parse_uint32(argv[idx+1], &closest) && closest,
+                       puts("Flag '-k' requires a positive integer"));
+                idx++;
+            }
+            else if (!strcmp(argv[idx], "-m"))
+            {
+                ASSERT(idx + 1 < argc && parse_uint32(argv[idx+1], &list_min), puts("Flag '-m' requires an integer"));
+                idx++;
+            }
+            else if (!strcmp(argv[idx], "--mem"))
+            {
+                ASSERT(idx + 1 < argc && parse_uint32(argv[idx+1], &memory) && memory,
+                       puts("Flag '--mem' requires a positive integer"));
+                idx++;
+            }
+            else if (!strcmp(argv[idx], "--tmp"))
+            {
+                ASSERT(idx + 1 < argc, puts("Flag '--tmp' requires a directory"));
+                tmpdir = argv[++idx];
+            }
+            else argv[kept++] = argv[idx];
+        }
+        argc = kept;
+    }
+
+    // Report the seed of the options which sample inputs, so that their runs can be reproduced
+    if (!strcmp(opt, "sample") || !strcmp(opt, "diff") || !strcmp(opt, "near") ||
+        !strcmp(opt, "sweep")  || !strcmp(opt, "rho") || !strcmp(opt, "birthday") ||
+        !strcmp(opt, "conform") || !strcmp(opt, "avalanche"))
+    {
+        fprintf(stderr, "seed: %llu\n", (unsigned long long) seed);
+    }
+    struct prng rng;
+    prng_seed(&rng, seed);
+
     // Switch on opt
     if (!strcmp(opt, "sample"))
     {
@@ -138,65 +487,119 @@ int main(int argc, char **argv)
         ASSERT(parse_uint32(argv[2], &n), puts("Argument 'n' was not an integer"));
         ASSERT(max >= min, puts("Max must be greater than or equal to min"));
         const uint32_t mod = 1 + max - min;
+
+        if (stats)
+        {
+            struct stats_conf conf = { &algo, -1, min, max, n, nthreads, seed };
+            run_stats(&conf);
+            return 0;
+        }
         
-        // Allocate a buffer large enough for any of our strings; we will be reusing this
-        uint8_t *buf = (uint8_t *) calloc(max, sizeof(uint8_t));
+        // Samples are generated a batch at a time, and sorted by length so
+        // that runs of samples with the same length can be hashed together.
+        // Keep a batch of maximum length samples to a reasonable size.
+        size_t batch = BATCH_SIZE;
+        if (batch * max > (1 << 24)) batch = max < (1 << 24)? (1 << 24) / max : 1;
+        uint32_t *lens  = (uint32_t *) calloc(batch, sizeof(uint32_t));
+        uint8_t *buf    = (uint8_t *) calloc((size_t) batch * max + 1, sizeof(uint8_t));
+        uint8_t *digests = (uint8_t *) calloc(batch, algo.dig_size);
 
-        // Start sampling
-        while (n-- > 0)
+        // Results are gathered into large buffers, which a writer thread
+        // writes out while the next batches are hashed
+        const size_t line = binary? record_size(&algo, max) : 2 * algo.dig_size + 5 + 2 * (size_t) max + 1;
+        const size_t cap = WRITER_BUFFER + batch * line;
+        struct writer *out = writer_start(STDOUT_FILENO);
+        uint8_t *text = malloc(cap);
+        size_t used = 0;
+        if (binary)
         {
-            // Pick a length in [min, max], and populate it with random data in [0, 256]
-            uint32_t len = min + (rand() % mod);
-            for (size_t idx = 0; idx < len; idx++) { buf[idx] = rand(); }
-            
-            // Compute and print the hash
-            printf("%s - 0x", algo.hash(buf, len, -1, hashbuf));
-            for (size_t idx = 0; idx < len; idx++) { printf("%02x", buf[idx]); }
-            printf("\n");
+            record_header_init((struct record_header *) text, &algo, max, -1);
+            used = sizeof(struct record_header);
         }
-        free(buf);
-        return 0;
-    }
-    else if (!strcmp(opt, "iterate"))
-    {
-        ASSERT(argc == 1, printf("Option 'iterate' requires 1 argument, got %d\n", argc));
-        uint32_t n;
-        ASSERT(parse_uint32(argv[0], &n), puts("Argument 'n' was not an integer"));
-        // Allocate a buffer large enough to store any of our strings; we will be reusing this
-        uint8_t *buf = (uint8_t *) calloc(n, sizeof(uint8_t)); 
-        // and fill it with zeroes
-        memset(buf, 0, n);
 
-        // Start iterating
-        while (1)
+        // Start sampling
+        while (n > 0)
         {
-            // Hash whatever is in buf
-            printf("%s - 0x", algo.hash(buf, n, -1, hashbuf));
-            for (size_t idx = 0; idx < n; idx++) { printf("%02x", buf[idx]); }
-            printf("\n");
+            size_t count = n < batch? n : batch;
+            n -= count;
 
-            // Take the successor of the input
-            size_t offset;
-            for (offset = 0; offset < n; offset++)
+            // Pick lengths in [min, max], and populate them with random data in [0, 256]
+            for (size_t idx = 0; idx < count; idx++) { lens[idx] = min + prng_below(&rng, mod); }
+            qsort(lens, count, sizeof(uint32_t), cmp_uint32);
+            size_t total = 0;
+            for (size_t idx = 0; idx < count; idx++) { total += lens[idx]; }
+            prng_fill(&rng, buf, total);
+            
+            // Compute the hashes, one run of equal lengths at a time
+            uint8_t *sent = buf;
+            for (size_t idx = 0, end; idx < count; idx = end)
             {
-                if (buf[n - offset - 1] == 255)
+                for (end = idx; end < count && lens[end] == lens[idx]; end++) ;
+                hash_many(&algo, sent, end - idx, lens[idx], -1, digests + idx * algo.dig_size);
+                sent += (end - idx) * lens[idx];
+            }
+
+            // and print them
+            sent = buf;
+            for (size_t idx = 0; idx < count; idx++)
+            {
+                const uint8_t *digest = digests + idx * algo.dig_size;
+                if (binary)
                 {
-                    buf[n - offset - 1] = 0;
-                    continue;
+                    put_record(text + used, &algo, max, sent, lens[idx], digest);
+                    used += line;
                 }
                 else
                 {
-                    buf[n - offset - 1]++;
-                    break;
+                    char *pos = (char *) text + used;
+                    to_hex(digest, algo.dig_size, pos);
+                    memcpy(pos + 2 * algo.dig_size, " - 0x", 5);
+                    to_hex(sent, lens[idx], pos + 2 * algo.dig_size + 5);
+                    used += 2 * algo.dig_size + 5 + 2 * lens[idx];
+                    text[used++] = '\n';
                 }
+                sent += lens[idx];
             }
-            // buf just wrapped back round to all zeroes; finished
-            if (offset == n)
+            if (used >= WRITER_BUFFER)
             {
-                break;
+                writer_put(out, text, used);
+                text = malloc(cap);
+                used = 0;
             }
         }
+        writer_put(out, text, used);
+        writer_finish(out);
+        free(lens);
         free(buf);
+        free(digests);
+        return 0;
+    }
+    else if (!strcmp(opt, "iterate"))
+    {
+        ASSERT(argc == 1, printf("Option 'iterate' requires 1 argument, got %d\n", argc));
+        uint32_t n;
+        ASSERT(parse_uint32(argv[0], &n), puts("Argument 'n' was not an integer"));
+        uint64_t total = iterate_total(n);
+        if (!has_end) end = total;
+        ASSERT(start <= end && end <= total,
+               printf("Range [%llu, %llu) is not within the %llu inputs of length %u\n",
+                      (unsigned long long) start, (unsigned long long) end, (unsigned long long) total, n));
+
+        struct iterate_conf conf = { &algo, n, start, end, ordered, binary, nthreads };
+        run_iterate(&conf);
+        return 0;
+    }
+    else if (!strcmp(opt, "file"))
+    {
+        ASSERT(argc >= 1, puts("Option 'file' requires at least 1 argument"));
+        struct files_conf conf = { &algo, -1, argv, argc, nthreads };
+        return run_files(&conf)? 1 : 0;
+    }
+    else if (!strcmp(opt, "batch"))
+    {
+        ASSERT(argc == 0, printf("Option 'batch' requires 0 arguments, got %d\n", argc));
+        struct batch_conf conf = { &algo, -1, prefixed, binary, nthreads };
+        run_batch(&conf);
         return 0;
     }
     else if (!strcmp(opt, "test"))
@@ -204,41 +607,198 @@ int main(int argc, char **argv)
         for (size_t idx = 0; idx < argc; idx++)
         {
             char *s = argv[idx];
-            printf("%s - \"%s\"\n", algo.hash(s, strlen(s), -1, hashbuf), s);
+            algo.hash_raw((uint8_t *) s, strlen(s), -1, digest);
+            printf("%s - \"%s\"\n", to_hex(digest, algo.dig_size, hashbuf), s);
         }
         return 0;
     }
-    else if (!strcmp(opt, "diff"))
+    else if (!strcmp(opt, "diff") || !strcmp(opt, "near") || !strcmp(opt, "sweep"))
     {
-        ASSERT(argc == 2, printf("Operation 'diff' requires 2 arguments, got %d\n", argc));
-        int rounds;
+        const bool near = !strcmp(opt, "near"), sweep = !strcmp(opt, "sweep");
+        ASSERT(argc >= 2, printf("Operation '%s' requires at least 2 arguments, got %d\n", opt, argc));
+        ASSERT((!near && !sweep) || !characteristic, printf("Flag '-c' cannot be used with '%s'\n", opt));
+        uint32_t rounds;
         ASSERT(parse_uint32(argv[0], &rounds), puts("Argument 'rounds' was not an integer"));
-        // No need to free these; program will only be terminated with ^C.
-        uint8_t *diff    = malloc(algo.blk_size),
-                *input1  = malloc(algo.blk_size),
-                *input2  = malloc(algo.blk_size),
-                *digest1 = malloc(2*algo.dig_size+1),
-                *digest2 = malloc(2*algo.dig_size+1);
-        for (int i = 0; i < algo.blk_size; i++)
-            ASSERT(parse_uint8(argv[1] + 2*(i+1), diff+i), printf("Could not parse hex byte at index %d\n", i));
-        while (1)
-        {
-            // Produce two inputs with a difference of diff
-            for (int i = 0; i < algo.blk_size; i++) input2[i] = diff[i] ^ (input1[i] = rand());
+        if (rounds > algo.max_rounds) rounds = algo.max_rounds;
 
-            // Compute and compare their hashes
-            algo.hash(input1, algo.blk_size, rounds, digest1);
-            algo.hash(input2, algo.blk_size, rounds, digest2);
-            // If a collision is detected, print the inputs + their colliding hash
-            if (!strcmp(digest1, digest2))
+        // Gather every difference, reading any @file arguments line by line
+        size_t ndiffs = 0, cap = 16;
+        uint8_t *diffs = malloc(cap * algo.blk_size);
+        for (int arg = 1; arg < argc; arg++)
+        {
+            FILE *file = NULL;
+            char *line = argv[arg], *buf = NULL;
+            size_t buf_len = 0;
+            if (argv[arg][0] == '@')
             {
-                for (int i = 0; i < algo.blk_size; i++) printf("%02x", input1[i]);
-                printf(" - ");
-                for (int i = 0; i < algo.blk_size; i++) printf("%02x", input2[i]);
-                printf(" => %s\n", digest1);
-                fflush(stdout);
+                file = fopen(argv[arg] + 1, "r");
+                ASSERT(file, printf("Unable to open file %s\n", argv[arg] + 1));
+            }
+            while (!file || getline(&buf, &buf_len, file) != -1)
+            {
+                if (file)
+                {
+                    // Skip blank lines; the diff is the first word on each line
+                    line = buf + strspn(buf, " \t");
+                    line[strcspn(line, " \t\r\n")] = '\0';
+                    if (!*line) continue;
+                }
+                if (ndiffs == cap) diffs = realloc(diffs, (cap *= 2) * algo.blk_size);
+                ASSERT(parse_hex(line, diffs + ndiffs * algo.blk_size, algo.blk_size),
+                       printf("Could not parse difference \"%s\"; expected %zu hex bytes\n", line, algo.blk_size));
+                ndiffs++;
+                if (!file) break;
+            }
+            if (file)
+            {
+                free(buf);
+                fclose(file);
             }
         }
+        ASSERT(ndiffs, puts("No differences were given"));
+
+        // Load the characteristic, if there is one
+        uint8_t *expect = NULL, *mask = NULL;
+        if (characteristic)
+        {
+            expect = malloc(rounds * algo.state_size + 1);
+            mask   = malloc(rounds * algo.state_size + 1);
+            ASSERT(read_characteristic(characteristic, &algo, rounds, expect, mask));
+        }
+
+        struct diff_conf conf = { &algo, rounds, diffs, ndiffs, expect, mask, near? closest : 0, sweep,
+                                  samples, nthreads, seed };
+        run_diff(&conf);
+        free(diffs);
+        free(expect);
+        free(mask);
+        return 0;
+    }
+    else if (!strcmp(opt, "rho"))
+    {
+        ASSERT(argc == 2, printf("Option 'rho' requires 2 arguments, got %d\n", argc));
+        uint32_t rounds, bits;
+        ASSERT(parse_uint32(argv[0], &rounds), puts("Argument 'rounds' was not an integer"));
+        ASSERT(parse_uint32(argv[1], &bits) && bits && bits <= 63 && bits <= 8 * algo.dig_size,
+               puts("Argument 'bits' must be between 1 and 63, and at most the digest size"));
+        if (rounds > algo.max_rounds) rounds = algo.max_rounds;
+
+        struct rho_conf conf = { &algo, rounds, bits, rho_dp_bits(bits, nthreads), samples? samples : 1,
+                                 nthreads, seed };
+        run_rho(&conf);
+        return 0;
+    }
+    else if (!strcmp(opt, "conform"))
+    {
+        ASSERT(argc == 2, printf("Option 'conform' requires 2 arguments, got %d\n", argc));
+        ASSERT(!strcmp(algo.name, "maw32"), puts("Option 'conform' only supports maw32"));
+        ASSERT(characteristic, puts("Option 'conform' requires a characteristic, given with '-c'"));
+        uint32_t rounds;
+        uint8_t diff[MAW32_BLOCK_SIZE];
+        ASSERT(parse_uint32(argv[0], &rounds), puts("Argument 'rounds' was not an integer"));
+        ASSERT(parse_hex(argv[1], diff, algo.blk_size),
+               printf("Could not parse difference \"%s\"; expected %zu hex bytes\n", argv[1], algo.blk_size));
+        if (rounds > algo.max_rounds) rounds = algo.max_rounds;
+
+        uint8_t *expect = malloc(rounds * algo.state_size + 1), *mask = malloc(rounds * algo.state_size + 1);
+        ASSERT(read_characteristic(characteristic, &algo, rounds, expect, mask));
+
+        struct conform_conf conf = { rounds, diff, expect, mask, samples? samples : 1, nthreads, seed };
+        run_conform(&conf);
+        free(expect);
+        free(mask);
+        return 0;
+    }
+    else if (!strcmp(opt, "census"))
+    {
+        ASSERT(argc == 3, printf("Option 'census' requires 3 arguments, got %d\n", argc));
+        uint32_t rounds, n;
+        uint8_t prefix[MAX_BLOCK_SIZE];
+        size_t prefix_len = strlen(argv[1]) / 2 - 1;
+        ASSERT(parse_uint32(argv[0], &rounds), puts("Argument 'rounds' was not an integer"));
+        ASSERT(prefix_len <= MAX_BLOCK_SIZE - 4 && parse_hex(argv[1], prefix, prefix_len),
+               printf("Argument 'prefix' must be at most %d hex bytes, such as 0x0102\n", MAX_BLOCK_SIZE - 4));
+        ASSERT(parse_uint32(argv[2], &n) && n >= 1 && n <= 4, puts("Argument 'n' must be between 1 and 4"));
+        if (rounds > algo.max_rounds) rounds = algo.max_rounds;
+
+        struct census_conf conf = { &algo, rounds, prefix, prefix_len, n, list_min, nthreads };
+        run_census(&conf);
+        return 0;
+    }
+    else if (!strcmp(opt, "preimage"))
+    {
+        ASSERT(argc == 3, printf("Option 'preimage' requires 3 arguments, got %d\n", argc));
+        uint32_t rounds, n;
+        ASSERT(parse_uint32(argv[0], &rounds), puts("Argument 'rounds' was not an integer"));
+        ASSERT(parse_uint32(argv[2], &n) && n >= 1 && n <= MAX_BLOCK_SIZE,
+               printf("Argument 'n' must be between 1 and %d\n", MAX_BLOCK_SIZE));
+        if (rounds > algo.max_rounds) rounds = algo.max_rounds;
+
+        size_t ntargets;
+        uint8_t *targets = read_hex_lines(argv[1], algo.dig_size, &ntargets);
+        ASSERT(targets);
+        ASSERT(ntargets, puts("No targets were given"));
+        uint64_t total = iterate_total(n);
+        if (!has_end || end > total) end = total;
+        ASSERT(start < end, puts("Flag '--start' must be below '--end'"));
+
+        struct preimage_conf conf = { &algo, rounds, targets, ntargets, n, start, end, nthreads };
+        run_preimage(&conf);
+        free(targets);
+        return 0;
+    }
+    else if (!strcmp(opt, "rainbow"))
+    {
+        ASSERT(argc == 5, printf("Option 'rainbow' requires 5 arguments, got %d\n", argc));
+        uint32_t rounds, n, length;
+        uint64_t chains;
+        ASSERT(parse_uint32(argv[0], &rounds), puts("Argument 'rounds' was not an integer"));
+        ASSERT(parse_uint32(argv[1], &n) && n >= 1 && n <= 4, puts("Argument 'n' must be between 1 and 4"));
+        ASSERT(parse_uint64(argv[2], &chains) && chains && chains <= iterate_total(n),
+               puts("Argument 'chains' must be positive, and at most the number of inputs"));
+        ASSERT(parse_uint32(argv[3], &length) && length, puts("Argument 'length' must be a positive integer"));
+        if (rounds > algo.max_rounds) rounds = algo.max_rounds;
+
+        struct rainbow_conf conf = { &algo, rounds, n, chains, length, argv[4], nthreads };
+        return run_rainbow(&conf)? 0 : 1;
+    }
+    else if (!strcmp(opt, "lookup"))
+    {
+        ASSERT(argc == 2, printf("Option 'lookup' requires 2 arguments, got %d\n", argc));
+        size_t ntargets;
+        uint8_t *targets = read_hex_lines(argv[1], algo.dig_size, &ntargets);
+        ASSERT(targets);
+
+        struct rainbow_lookup_conf conf = { &algo, argv[0], targets, ntargets, nthreads };
+        long found = run_rainbow_lookup(&conf);
+        free(targets);
+        return found < 0? 1 : 0;
+    }
+    else if (!strcmp(opt, "birthday"))
+    {
+        ASSERT(argc == 3, printf("Option 'birthday' requires 3 arguments, got %d\n", argc));
+        uint32_t rounds, bits;
+        uint64_t n;
+        ASSERT(parse_uint32(argv[0], &rounds), puts("Argument 'rounds' was not an integer"));
+        ASSERT(parse_uint32(argv[1], &bits) && bits && bits <= 64 && bits <= 8 * algo.dig_size,
+               puts("Argument 'bits' must be between 1 and 64, and at most the digest size"));
+        ASSERT(parse_uint64(argv[2], &n), puts("Argument 'n' was not an integer"));
+        if (rounds > algo.max_rounds) rounds = algo.max_rounds;
+
+        struct birthday_conf conf = { &algo, rounds, bits, n, (size_t) memory << 20, tmpdir, nthreads, seed };
+        return run_birthday(&conf)? 0 : 1;
+    }
+    else if (!strcmp(opt, "avalanche"))
+    {
+        ASSERT(argc == 2, printf("Option 'avalanche' requires 2 arguments, got %d\n", argc));
+        uint32_t rounds, n;
+        ASSERT(parse_uint32(argv[0], &rounds), puts("Argument 'rounds' was not an integer"));
+        ASSERT(parse_uint32(argv[1], &n), puts("Argument 'n' was not an integer"));
+        if (rounds > algo.max_rounds) rounds = algo.max_rounds;
+
+        struct avalanche_conf conf = { &algo, rounds, n, nthreads, seed };
+        run_avalanche(&conf);
+        return 0;
     }
     else
     {
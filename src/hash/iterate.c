@@ -0,0 +1,197 @@
+// Multithreaded enumeration of every bytestring of a given length
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sched.h>
+
+#include "util.h"
+#include "algo.h"
+#include "channel.h"
+#include "threads.h"
+#include "records.h"
+#include "iterate.h"
+
+// A chunk of formatted output, passed from a worker to the writer
+struct chunk
+{
+    uint64_t seq;                   // Which chunk of the range this is
+    char *text;                     // Formatted lines; owned by the writer once sent
+    size_t len;                     // Length of text in bytes
+};
+
+// State shared by every worker
+struct iterate_state
+{
+    const struct iterate_conf *conf;
+    struct channel *done;           // Finished chunks, in whatever order they finish
+    uint64_t nchunks;               // How many chunks the range is split into
+    uint64_t window;                // How far ahead of the writer workers may run
+    char pad0[CACHE_LINE];
+    uint64_t claimed;               // Next chunk to be claimed by a worker
+    char pad1[CACHE_LINE];
+    uint64_t written;               // How many chunks the writer has written out
+    char pad2[CACHE_LINE];
+};
+
+// Advance buf to the next bytestring of length n
+// Returns: false when buf wraps back round to all zeroes
+static inline bool next_input(uint8_t *buf, size_t n)
+{
+    for (size_t offset = 0; offset < n; offset++)
+    {
+        if (buf[n - offset - 1] == 255)
+        {
+            buf[n - offset - 1] = 0;
+            continue;
+        }
+        else
+        {
+            buf[n - offset - 1]++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Write the input with index idx into buf, as an n-byte big-endian integer
+static inline void index_input(uint64_t idx, uint8_t *buf, size_t n)
+{
+    for (size_t off = 0; off < n; off++) buf[n - off - 1] = off < 8? (uint8_t)(idx >> (8 * off)) : 0;
+}
+
+// Worker thread; claims chunks, hashes them and formats the results
+static void *iterate_worker_main(void *arg)
+{
+    struct iterate_state *state = (struct iterate_state *) arg;
+    const struct iterate_conf *conf = state->conf;
+    const struct hash_algo *algo = conf->algo;
+    const size_t n = conf->len, dig = algo->dig_size;
+    // Every line is "digest - 0xinput\n", unless records are being written
+    const size_t line = conf->binary? record_size(algo, n) : 2 * dig + 5 + 2 * n + 1;
+
+    uint8_t *buf     = calloc(n + 1, 1),
+            *batch   = calloc((size_t) BATCH_SIZE * n + 1, 1),
+            *digests = calloc(BATCH_SIZE, dig);
+    while (1)
+    {
+        uint64_t seq = __atomic_fetch_add(&state->claimed, 1, __ATOMIC_RELAXED);
+        if (seq >= state->nchunks) break;
+        uint64_t first = conf->start + seq * ITERATE_CHUNK;
+        size_t left = conf->end - first < ITERATE_CHUNK? conf->end - first : ITERATE_CHUNK;
+
+        // Keep the reorder buffer bounded by not running too far ahead of the writer
+        if (conf->ordered)
+        {
+            while (seq >= __atomic_load_n(&state->written, __ATOMIC_ACQUIRE) + state->window) sleep_ms(1);
+        }
+
+        struct chunk out = { seq, malloc(left * line + 1), 0 };
+        index_input(first, buf, n);
+        while (left)
+        {
+            // Successive inputs are copied into batch, then hashed together
+            size_t count = left < BATCH_SIZE? left : BATCH_SIZE;
+            for (size_t idx = 0; idx < count; idx++)
+            {
+                memcpy(batch + idx * n, buf, n);
+                next_input(buf, n);
+            }
+            hash_many(algo, batch, count, n, -1, digests);
+
+            for (size_t idx = 0; conf->binary && idx < count; idx++)
+            {
+                put_record((uint8_t *) out.text + out.len, algo, n, batch + idx * n, n, digests + idx * dig);
+                out.len += line;
+            }
+            for (size_t idx = 0; !conf->binary && idx < count; idx++)
+            {
+                char *pos = out.text + out.len;
+                to_hex(digests + idx * dig, dig, pos);
+                memcpy(pos + 2 * dig, " - 0x", 5);
+                to_hex(batch + idx * n, n, pos + 2 * dig + 5);
+                pos[line - 1] = '\n';
+                out.len += line;
+            }
+            left -= count;
+        }
+        while (!channel_try_push(state->done, &out)) sched_yield();
+    }
+    free(buf);
+    free(batch);
+    free(digests);
+    return NULL;
+}
+
+// Hash and print every input in the configured range
+void run_iterate(const struct iterate_conf *conf)
+{
+    struct iterate_state state = { conf };
+    uint64_t inputs = conf->end - conf->start;
+    state.nchunks = inputs / ITERATE_CHUNK + (inputs % ITERATE_CHUNK != 0);
+    state.window  = 4 * conf->nthreads;
+    state.done    = channel_new(state.window, sizeof(struct chunk));
+
+    if (conf->binary)
+    {
+        struct record_header header;
+        record_header_init(&header, conf->algo, conf->len, -1);
+        fwrite(&header, sizeof(header), 1, stdout);
+    }
+
+    pthread_t *tids = calloc(conf->nthreads, sizeof(pthread_t));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_create(&tids[idx], NULL, iterate_worker_main, &state);
+    }
+
+    // Act as the single writer. Chunks which finish early wait in pending,
+    // at position seq % window, until every chunk before them is written
+    struct chunk *pending = calloc(state.window, sizeof(struct chunk)), got;
+    uint64_t written = 0, last_written = 0;
+    double last = now_seconds();
+    while (written < state.nchunks)
+    {
+        bool idle = true;
+        while (channel_try_pop(state.done, &got))
+        {
+            idle = false;
+            if (conf->ordered)
+            {
+                pending[got.seq % state.window] = got;
+                continue;
+            }
+            fwrite(got.text, 1, got.len, stdout);
+            free(got.text);
+            written++;
+        }
+        while (conf->ordered && written < state.nchunks && pending[written % state.window].text)
+        {
+            struct chunk *next = &pending[written % state.window];
+            fwrite(next->text, 1, next->len, stdout);
+            free(next->text);
+            next->text = NULL;
+            written++;
+        }
+        __atomic_store_n(&state.written, written, __ATOMIC_RELEASE);
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            uint64_t done = written < inputs / ITERATE_CHUNK? written * ITERATE_CHUNK : inputs;
+            log_line(stderr, "%llu/%llu inputs (%.3e/s)", (unsigned long long) done,
+                     (unsigned long long) inputs, (double)(done - last_written) / (now - last));
+            last_written = done;
+            last = now;
+        }
+        if (idle) sleep_ms(1);
+    }
+    fflush(stdout);
+
+    for (size_t idx = 0; idx < conf->nthreads; idx++) pthread_join(tids[idx], NULL);
+    free(tids);
+    free(pending);
+    channel_free(state.done);
+}
@@ -0,0 +1,43 @@
+// Multithreaded enumeration of every bytestring of a given length
+
+#ifndef __ITERATE
+#define __ITERATE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "algo.h"
+
+// How many consecutive inputs make up one chunk of work
+#define ITERATE_CHUNK (16 * BATCH_SIZE)
+
+// Configuration of an iteration
+struct iterate_conf
+{
+    const struct hash_algo *algo;   // Algorithm being run
+    size_t len;                     // Length of every input, in bytes
+    uint64_t start, end;            // Range of input indices to hash, end exclusive
+    bool ordered;                   // Print inputs in order, rather than as chunks finish
+    bool binary;                    // Write binary records rather than text lines
+    size_t nthreads;                // How many worker threads to run
+};
+
+// Number of inputs of length len, saturating at UINT64_MAX for len >= 8
+static inline uint64_t iterate_total(size_t len)
+{
+    return len >= 8? UINT64_MAX : (uint64_t) 1 << (8 * len);
+}
+
+// Hash every input of length len whose index lies in [start, end), where
+// input i is the big-endian encoding of i. The range is split into chunks of
+// ITERATE_CHUNK consecutive inputs, which workers claim in turn, and hash and
+// format into text by themselves. The calling thread writes the text to
+// stdout, either in input order by holding early chunks in a reorder buffer,
+// or in whichever order the chunks finish. In binary mode, a record header
+// and one fixed-size record per input are written instead of text lines.
+// Workers never run more than a few chunks per thread ahead of the writer, so
+// memory use stays bounded.
+// Params:
+// - conf: Configuration of the iteration
+void run_iterate(const struct iterate_conf *conf);
+
+#endif // __ITERATE
@@ -5,89 +5,336 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "util.h"
+#include "maw32.h"
 
 // Utilities for MAW32
-#define MAW32_BLOCK_SIZE  8 // 64 bits => 8 bytes for every block
-#define MAW32_DIGEST_SIZE 4 // 32 bits => 4 bytes for the digest
 static inline uint8_t rotr(uint8_t x, uint8_t n) { return (x >> n) | (x << (8 - n)); }
 static inline uint8_t maj(uint8_t x, uint8_t y, uint8_t z) { return (x & y) ^ (x & z) ^ (y & z); }
 static inline uint8_t sigma0(uint8_t x) { return rotr(x, 2) ^ rotr(x, 3) ^ rotr(x, 5); }
 static inline uint8_t sigma1(uint8_t x) { return rotr(x, 1) ^ rotr(x, 4) ^ (x >> 3); }
 
-// Fetch the next block from the input; if padding is required, this will be
-// emplaced in a local buffer. Repeat calls to next_block with the same pointer
-// will return sequential blocks until the final block has been consumed; at
-// this point, NULL will be returned. If a different pointer is passed, then
-// the first block of the new pointer is fetched, and the process restarts
-static uint8_t *next_block(const uint8_t *ptr, size_t len)
+// Constants used by every block
+static const uint8_t K[16] = 
 {
-    static const uint8_t *lastptr = NULL;       // Start of the first block of the input we are chunking
-    static size_t idx = 0;                      // Index of the next block
-    static uint8_t local[MAW32_BLOCK_SIZE];     // Local buffer for storing partial blocks
-    static int needs_empty_block = 0;           // Whether or not we have a case where the final block is empty
+    0xb7, 0xe1, 0x51, 0x62, 
+    0x8a, 0xed, 0x2a, 0x6a,
+    0xbf, 0x71, 0x58, 0x80,
+    0x9c, 0xf4, 0xf3, 0xc7
+};
 
-    // New input
-    if (lastptr != ptr)
+// Registers at the start of the first block
+static const uint8_t IV[4] = { 0x24, 0x3f, 0x6a, 0x88 };
+
+// Run the compression function over a single block M, updating H in-place.
+// This is only ever inlined with a constant number of rounds, so that the
+// loop is fully unrolled and only as much of the schedule as is used is made
+static inline __attribute__((always_inline)) void compress_body(uint8_t *H, const uint8_t *M, const int rounds)
+{
+    // Registers
+    uint8_t a = H[0], b = H[1], c = H[2], d = H[3];
+    // Message schedule
+    uint8_t W[16];
+
+    // Transform this block
+    #pragma GCC unroll 16
+    for (int t = 0; t < rounds; t++)
     {
-        lastptr = ptr;
-        idx = 0;
-        needs_empty_block = 0;
+        // Set up the message schedule for this round
+        if (t < 8) { W[t] = M[t]; }
+        else { W[t] = sigma0(W[t-3]) + W[t-4] + sigma1(W[t-8]); }
+        uint8_t t1 = d + sigma1(b) + K[t] + W[t];
+        uint8_t t2 = sigma0(a) + maj(a, b, c);
+        d = c;
+        c = b + t1;
+        b = a;
+        a = t1 + t2;
     }
+    
+    // Update H
+    H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+}
+
+// Every supported round count
+#define MAW32_ROUNDS(X) \
+    X(0)  X(1)  X(2)  X(3)  X(4)  X(5)  X(6)  X(7)  X(8) \
+    X(9)  X(10) X(11) X(12) X(13) X(14) X(15) X(16)
+
+// One compression function specialised for each round count
+#define COMPRESS_N(n) static void compress_##n(uint8_t *H, const uint8_t *M) { compress_body(H, M, n); }
+MAW32_ROUNDS(COMPRESS_N)
+#undef COMPRESS_N
+
+// The specialised compression functions, indexed by round count
+#define COMPRESS_ENTRY(n) compress_##n,
+static void (*const compress_rounds[17])(uint8_t *, const uint8_t *) = { MAW32_ROUNDS(COMPRESS_ENTRY) };
+#undef COMPRESS_ENTRY
+
+// Run round t of the compression function over the registers S = (a, b, c, d)
+static inline void round_step(uint8_t *S, uint8_t w, int t)
+{
+    uint8_t t1 = S[3] + sigma1(S[1]) + K[t] + w;
+    uint8_t t2 = sigma0(S[0]) + maj(S[0], S[1], S[2]);
+    S[3] = S[2]; S[2] = S[1] + t1; S[1] = S[0]; S[0] = t1 + t2;
+}
+
+// Determine if the registers of a pair follow the characteristic after round t
+static inline bool round_follows(const uint8_t *expect, const uint8_t *mask,
+                                 const uint8_t *S1, const uint8_t *S2, int t)
+{
+    const uint8_t *e = expect + 4*t, *m = mask + 4*t;
+    return !((((S1[0] ^ S2[0]) ^ e[0]) & m[0]) | (((S1[1] ^ S2[1]) ^ e[1]) & m[1]) |
+             (((S1[2] ^ S2[2]) ^ e[2]) & m[2]) | (((S1[3] ^ S2[3]) ^ e[3]) & m[3]));
+}
+
+// Run the first block of two messages through the compression function in
+// lockstep, checking the difference in the registers after every round
+size_t maw32_pair_check(const uint8_t *M1, const uint8_t *M2, size_t rounds,
+                        const uint8_t *expect, const uint8_t *mask)
+{
+    // Ensure rounds is valid
+    if (rounds > 16) rounds = 16;
 
-    // Edge case: we hit case #3 last time, and need to produce a block with all zeroes + length
-    if (needs_empty_block)
+    // Registers, starting from the IV
+    uint8_t S1[4], S2[4];
+    memcpy(S1, IV, 4);
+    memcpy(S2, IV, 4);
+    // Message schedules
+    uint8_t W1[16], W2[16];
+
+    for (int t = 0; t < rounds; t++)
     {
-        memset(local, 0, MAW32_BLOCK_SIZE - 4);
-        *(uint32_t *)(local + MAW32_BLOCK_SIZE - 4) = h2b32(len * 8);
-        idx += MAW32_BLOCK_SIZE;
-        needs_empty_block = 0;
-        return local;
+        // Set up the message schedules for this round
+        if (t < 8) { W1[t] = M1[t]; W2[t] = M2[t]; }
+        else
+        {
+            W1[t] = sigma0(W1[t-3]) + W1[t-4] + sigma1(W1[t-8]);
+            W2[t] = sigma0(W2[t-3]) + W2[t-4] + sigma1(W2[t-8]);
+        }
+
+        // Transform both states, giving up as soon as the pair leaves the characteristic
+        round_step(S1, W1[t], t);
+        round_step(S2, W2[t], t);
+        if (!round_follows(expect, mask, S1, S2, t)) return t;
     }
+    return rounds;
+}
 
-    // Marker that we have exhausted all the data in ptr
-    if (idx > len)
+// State of a search for conforming pairs, shared by every level of it
+struct conform_search
+{
+    const uint8_t *start, *diff, *expect, *mask;
+    size_t fixed, rounds;
+    uint64_t *reached;
+    bool (*found)(const uint8_t *, void *);
+    void *arg;
+    const int *stop;
+    uint64_t pairs;                 // How many conforming pairs have been found
+    bool done;                      // Set once found asks for no more
+    uint8_t W1[16], W2[16];         // Message schedules of the pair so far
+};
+
+// The pair has followed every round of the characteristic; pass it on
+static inline void conform_report(struct conform_search *cs)
+{
+    cs->pairs++;
+    if (!cs->found(cs->W1, cs->arg)) cs->done = true;
+}
+
+// Every message byte is fixed; run the remaining rounds, abandoning the pair
+// on the first one it fails
+static void conform_finish(struct conform_search *cs, const uint8_t *S1, const uint8_t *S2)
+{
+    uint8_t N1[4], N2[4], *W1 = cs->W1, *W2 = cs->W2;
+    memcpy(N1, S1, 4);
+    memcpy(N2, S2, 4);
+    for (int t = 8; t < cs->rounds; t++)
     {
-        lastptr = NULL;
-        return NULL;
+        W1[t] = sigma0(W1[t-3]) + W1[t-4] + sigma1(W1[t-8]);
+        W2[t] = sigma0(W2[t-3]) + W2[t-4] + sigma1(W2[t-8]);
+        round_step(N1, W1[t], t);
+        round_step(N2, W2[t], t);
+        if (!round_follows(cs->expect, cs->mask, N1, N2, t)) return;
+        __atomic_store_n(&cs->reached[t], cs->reached[t] + 1, __ATOMIC_RELAXED);
     }
-    
-    // Pointer to the next [potentially partial] block
-    const uint8_t *block = ptr + idx;
-    // How many bytes of actual data remain
-    size_t partial = len - idx;
+    conform_report(cs);
+}
+
+// Fix byte t of the message, given the registers of the pair after t rounds
+static void conform_level(struct conform_search *cs, int t, const uint8_t *S1, const uint8_t *S2)
+{
+    if (cs->done || (cs->stop && __atomic_load_n(cs->stop, __ATOMIC_RELAXED))) return;
 
-    // Do we have a full block to send
-    if (partial >= MAW32_BLOCK_SIZE)
+    // Every round of the characteristic is behind us; the rest of the bytes are free
+    if (t == cs->rounds)
     {
-        // Mark that this block has been consumed
-        idx += MAW32_BLOCK_SIZE;
-        return block;
+        for (int k = t; k < 8; k++)
+        {
+            cs->W1[k] = cs->start[k];
+            cs->W2[k] = cs->start[k] ^ cs->diff[k];
+        }
+        conform_report(cs);
+        return;
     }
-    // A partial block which can fit at least 1 byte padding + length
-    else if (partial <= MAW32_BLOCK_SIZE - 1 - 4)
+    if (t == 8)
     {
-        // Copy the partial block into local, then append bits as per the standard
-        memcpy(local, block, partial);
-        local[partial++] = 0x80;
-        while (partial < MAW32_BLOCK_SIZE - 4) { local[partial++] = 0x00; }
-        // Append the length (in bits) as a big-endian 64-bit int
-        *(uint32_t *)(local + partial) = h2b32(len * 8);
-        idx += MAW32_BLOCK_SIZE;
-        return local;
+        conform_finish(cs, S1, S2);
+        return;
     }
-    // A partial block which requires the creation of an extra block afterwards (56 to 63 bytes)
-    else
+
+    // Only values of this byte which keep the pair on the characteristic are followed
+    int values = t < cs->fixed? 1 : 256;
+    for (int k = 0; k < values && !cs->done; k++)
     {
-        // Copy the partial block into local, then append bits as per the standard
-        memcpy(local, block, partial);
-        local[partial++] = 0x80;
-        while (partial < MAW32_BLOCK_SIZE) { local[partial++] = 0x00; }
-        idx += MAW32_BLOCK_SIZE;
-        needs_empty_block = 1;
-        return local;
+        uint8_t N1[4], N2[4];
+        memcpy(N1, S1, 4);
+        memcpy(N2, S2, 4);
+        cs->W1[t] = cs->start[t] + k;
+        cs->W2[t] = cs->W1[t] ^ cs->diff[t];
+        round_step(N1, cs->W1[t], t);
+        round_step(N2, cs->W2[t], t);
+        if (!round_follows(cs->expect, cs->mask, N1, N2, t)) continue;
+        __atomic_store_n(&cs->reached[t], cs->reached[t] + 1, __ATOMIC_RELAXED);
+        conform_level(cs, t + 1, N1, N2);
     }
 }
 
+// Search for pairs following the characteristic, fixing the message one byte
+// per round
+uint64_t maw32_conform(const uint8_t *start, size_t fixed, const uint8_t *diff, size_t rounds,
+                       const uint8_t *expect, const uint8_t *mask, uint64_t *reached,
+                       bool (*found)(const uint8_t *, void *), void *arg, const int *stop)
+{
+    // Ensure rounds is valid
+    if (rounds > 16) rounds = 16;
+    if (fixed > 8) fixed = 8;
+
+    struct conform_search cs = { start, diff, expect, mask, fixed, rounds, reached, found, arg, stop };
+    conform_level(&cs, 0, IV, IV);
+    return cs.pairs;
+}
+
+// Hash the input once for every round count from 1 to rounds, sharing the
+// work done on the first block between all of them
+void maw32_hash_sweep(const uint8_t *ptr, size_t len, size_t rounds, uint8_t *states, uint8_t *digests)
+{
+    // Ensure rounds is valid
+    if (rounds > 16) rounds = 16;
+
+    // Lay out the padded tail: whatever is left past the last full block, the
+    // 1-bit, zeroes, then the length as a big-endian 32-bit int
+    size_t full = len - len % MAW32_BLOCK_SIZE;
+    uint8_t tail[2*MAW32_BLOCK_SIZE] = { 0 };
+    memcpy(tail, ptr + full, len - full);
+    tail[len - full] = 0x80;
+    size_t tail_len = len - full + 1 + 4 <= MAW32_BLOCK_SIZE? MAW32_BLOCK_SIZE : 2*MAW32_BLOCK_SIZE;
+    uint32_t bits = h2b32(len * 8);
+    memcpy(tail + tail_len - 4, &bits, sizeof(bits));
+    size_t nblocks = (full + tail_len) / MAW32_BLOCK_SIZE;
+    #define BLOCK(i) ((i) * MAW32_BLOCK_SIZE < full? ptr + (i) * MAW32_BLOCK_SIZE \
+                                                   : tail + (i) * MAW32_BLOCK_SIZE - full)
+
+    // Run the first block once, recording the registers after every round
+    uint8_t trace[16][4];
+    uint8_t S[4], W[16];
+    memcpy(S, IV, 4);
+    const uint8_t *M = BLOCK(0);
+    for (int t = 0; t < rounds; t++)
+    {
+        if (t < 8) { W[t] = M[t]; }
+        else { W[t] = sigma0(W[t-3]) + W[t-4] + sigma1(W[t-8]); }
+        round_step(S, W[t], t);
+        memcpy(trace[t], S, 4);
+    }
+    if (states) memcpy(states, trace, 4 * rounds);
+    if (!digests) return;
+
+    // Stopping after round t gives the chaining value for t rounds; the
+    // remaining blocks depend on it, so have to be run for each t separately
+    for (size_t t = 0; t < rounds; t++)
+    {
+        uint8_t *H = digests + MAW32_DIGEST_SIZE * t;
+        for (int k = 0; k < 4; k++) H[k] = IV[k] + trace[t][k];
+        void (*compress)(uint8_t *, const uint8_t *) = compress_rounds[t + 1];
+        for (size_t i = 1; i < nblocks; i++) compress(H, BLOCK(i));
+    }
+    #undef BLOCK
+}
+
+// Initialise a MAW32 context, ready to accept input
+void maw32_init(struct maw32_ctx *ctx, size_t rounds)
+{
+    // Ensure rounds is valid
+    if (rounds > 16) rounds = 16;
+
+    // Set up the IV
+    memcpy(ctx->H, IV, 4);
+    ctx->compress = compress_rounds[rounds];
+    ctx->rounds   = rounds;
+    ctx->len      = 0;
+    ctx->buf_len  = 0;
+}
+
+// Feed len bytes of ptr into the context
+void maw32_update(struct maw32_ctx *ctx, const uint8_t *ptr, size_t len)
+{
+    ctx->len += len;
+
+    // Top up a partial block left over from the previous call
+    if (ctx->buf_len)
+    {
+        size_t take = MAW32_BLOCK_SIZE - ctx->buf_len;
+        if (take > len) take = len;
+        memcpy(ctx->buf + ctx->buf_len, ptr, take);
+        ctx->buf_len += take;
+        ptr += take;
+        len -= take;
+        if (ctx->buf_len < MAW32_BLOCK_SIZE) return;
+        ctx->compress(ctx->H, ctx->buf);
+        ctx->buf_len = 0;
+    }
+
+    // Full blocks are compressed straight out of the caller's buffer
+    for ( ; len >= MAW32_BLOCK_SIZE; ptr += MAW32_BLOCK_SIZE, len -= MAW32_BLOCK_SIZE)
+    {
+        ctx->compress(ctx->H, ptr);
+    }
+
+    // Stash whatever remains for next time
+    memcpy(ctx->buf, ptr, len);
+    ctx->buf_len = len;
+}
+
+// Pad the input, and write the raw 4-byte digest into digest
+void maw32_final(struct maw32_ctx *ctx, uint8_t *digest)
+{
+    size_t partial = ctx->buf_len;
+    ctx->buf[partial++] = 0x80;
+
+    // Not enough room for the length; pad out this block and use another
+    if (partial > MAW32_BLOCK_SIZE - 4)
+    {
+        while (partial < MAW32_BLOCK_SIZE) { ctx->buf[partial++] = 0x00; }
+        ctx->compress(ctx->H, ctx->buf);
+        partial = 0;
+    }
+    while (partial < MAW32_BLOCK_SIZE - 4) { ctx->buf[partial++] = 0x00; }
+    // Append the length (in bits) as a big-endian 32-bit int
+    uint32_t bits = h2b32(ctx->len * 8);
+    memcpy(ctx->buf + partial, &bits, sizeof(bits));
+    ctx->compress(ctx->H, ctx->buf);
+
+    memcpy(digest, ctx->H, MAW32_DIGEST_SIZE);
+}
+
+// Compute the raw MAW32 digest of the input into digest
+void maw32_hash_raw(const uint8_t *ptr, size_t len, size_t rounds, uint8_t *digest)
+{
+    struct maw32_ctx ctx;
+    maw32_init(&ctx, rounds);
+    maw32_update(&ctx, ptr, len);
+    maw32_final(&ctx, digest);
+}
+
 // Compute the MAW32 hash of the input.
 // Params:
 // - ptr: A non-null pointer to an array of data to hash
@@ -103,51 +350,8 @@ char *maw32_hash(const uint8_t *ptr, size_t len, size_t rounds, char *buf)
     // No pointer
     if (!ptr) { return NULL; }
 
-    // Ensure rounds is valid
-    if (rounds > 16) rounds = 16;
-
-    // Set up the IV
-    uint8_t H[4] = 
-    {
-        0x24, 0x3f, 0x6a, 0x88
-    };
-
-    // Set up the constants
-    uint8_t K[16] = 
-    {
-        0xb7, 0xe1, 0x51, 0x62, 
-        0x8a, 0xed, 0x2a, 0x6a,
-        0xbf, 0x71, 0x58, 0x80,
-        0x9c, 0xf4, 0xf3, 0xc7
-    };
-
-    // Current block
-    uint8_t *M = NULL;
-    int block = 0;
-    while ((M = next_block(ptr, len)) != NULL)
-    {
-        // Registers
-        uint8_t a = H[0], b = H[1], c = H[2], d = H[3];
-        // Message schedule
-        uint8_t W[16];
-    
-        // Transform this block
-        for (int t = 0; t < rounds; t++)
-        {
-            // Set up the message schedule for this round
-            if (t < 8) { W[t] = M[t]; }
-            else { W[t] = sigma0(W[t-3]) + W[t-4] + sigma1(W[t-8]); }
-            uint8_t t1 = d + sigma1(b) + K[t] + W[t];
-            uint8_t t2 = sigma0(a) + maj(a, b, c);
-            d = c;
-            c = b + t1;
-            b = a;
-            a = t1 + t2;
-        }
-        
-        // Update H
-        H[0] += a; H[1] += b; H[2] += c; H[3] += d;
-    }
+    uint8_t H[MAW32_DIGEST_SIZE];
+    maw32_hash_raw(ptr, len, rounds, H);
 
     // Copy H into buf, using a local buffer if necessary
     static char local[2*MAW32_DIGEST_SIZE+1];
@@ -58,8 +58,142 @@
 //   }
 //   H is now the MAW32 hash of the input
 
+#ifndef __MAW32
+#define __MAW32
+
 #include <stdio.h>  // size_t
 #include <stdint.h> // uint8_t
+#include <stdbool.h>
+
+#define MAW32_BLOCK_SIZE  8 // 64 bits => 8 bytes for every block
+#define MAW32_DIGEST_SIZE 4 // 32 bits => 4 bytes for the digest
+
+// Streaming state for MAW32. Every context is independent, so separate
+// contexts may be used concurrently from separate threads
+struct maw32_ctx
+{
+    uint8_t H[MAW32_DIGEST_SIZE];   // Chaining value
+    uint8_t buf[MAW32_BLOCK_SIZE];  // Partial block carried between updates
+    size_t buf_len;                 // How many bytes of buf are in use
+    uint64_t len;                   // Total length of the input so far, in bytes
+    size_t rounds;                  // How many rounds of the hash function to run
+    void (*compress)(uint8_t *, const uint8_t *); // Compression function unrolled for this many rounds
+};
+
+// Initialise a MAW32 context, ready to accept input.
+// Params:
+// - ctx: The context to initialise
+// - rounds: How many rounds of the hash function to run
+void maw32_init(struct maw32_ctx *ctx, size_t rounds);
+
+// Feed more input into a MAW32 context. Input may be supplied in chunks of
+// any size; full blocks are read directly from ptr without being copied.
+// Params:
+// - ctx: An initialised context
+// - ptr: A pointer to len bytes of data to hash
+// - len: The length of ptr in bytes
+void maw32_update(struct maw32_ctx *ctx, const uint8_t *ptr, size_t len);
+
+// Pad the input and produce the final digest. The context must be
+// reinitialised with maw32_init before it is used again.
+// Params:
+// - ctx: An initialised context
+// - digest: A block of at least 4 bytes in which to store the raw digest
+void maw32_final(struct maw32_ctx *ctx, uint8_t *digest);
+
+// Compute the raw MAW32 digest of the input.
+// Params:
+// - ptr: A non-null pointer to an array of data to hash
+// - len: The length of ptr in bytes
+// - rounds: How many rounds of the hash function to run
+// - digest: A block of at least 4 bytes in which to store the digest
+void maw32_hash_raw(const uint8_t *ptr, size_t len, size_t rounds, uint8_t *digest);
+
+// Compute the raw MAW32 digests of many messages at once. Messages are hashed
+// in groups using the widest SIMD kernel supported by the CPU, falling back
+// to scalar code if there is none.
+// Params:
+// - msgs: A pointer to n messages of len bytes each, stored back-to-back
+// - n: How many messages to hash
+// - len: The length of every message in bytes
+// - rounds: How many rounds of the hash function to run
+// - out: A block of at least 4*n bytes in which to store the digests
+void maw32_hash_many(const uint8_t *msgs, size_t n, size_t len, size_t rounds, uint8_t *out);
+
+// As maw32_hash_many, for messages which all begin with the same blocks. The
+// shared blocks are compressed only once, and the chaining value after them
+// is used as the starting point for every message.
+// Params:
+// - msgs: A pointer to n messages of len bytes each, stored back-to-back
+// - n: How many messages to hash
+// - len: The length of every message in bytes
+// - shared: How many whole blocks at the start of every message are the same;
+//           at most len/8
+// - rounds: How many rounds of the hash function to run
+// - out: A block of at least 4*n bytes in which to store the digests
+void maw32_hash_many_shared(const uint8_t *msgs, size_t n, size_t len, size_t shared,
+                            size_t rounds, uint8_t *out);
+
+// Name the kernel used by maw32_hash_many on this CPU, e.g. "avx2"
+const char *maw32_many_backend();
+
+// Run the first block of two messages through the compression function in
+// lockstep, checking the XOR difference of the registers (a, b, c, d) after
+// every round against a differential characteristic. The pair is abandoned as
+// soon as any masked bit differs from the characteristic.
+// Params:
+// - M1, M2: The first block of each message; 8 bytes each
+// - rounds: How many rounds of the hash function to run
+// - expect: The expected difference in (a, b, c, d) after each round; 4*rounds bytes
+// - mask: Which bits of expect must be matched after each round; 4*rounds bytes
+// Returns: How many rounds the pair followed the characteristic for; this is
+//          rounds if the pair conforms to the whole characteristic
+size_t maw32_pair_check(const uint8_t *M1, const uint8_t *M2, size_t rounds,
+                        const uint8_t *expect, const uint8_t *mask);
+
+// Search for single-block messages M1 whose pair M2 = M1 ^ diff follows a
+// differential characteristic through the first block, using message
+// modification. The schedule word W_t is message byte t for the first 8
+// rounds, and byte t enters no earlier round, so the bytes are fixed one at a
+// time: every value of byte t is tried in turn from start[t], and the search
+// only descends into those for which the pair still follows the
+// characteristic after round t. Once all 8 bytes are fixed, the remaining
+// rounds are run in turn, and the pair is abandoned on the first one it
+// fails. The first fixed bytes are taken straight from start, as are bytes
+// which only enter rounds past rounds, since they are never checked.
+// Params:
+// - start: Where to start trying the values of each byte of M1; 8 bytes
+// - fixed: How many leading bytes of start are kept as they are; at most 8
+// - diff: The XOR difference between the messages; 8 bytes
+// - rounds: How many rounds of the characteristic the pairs must follow
+// - expect, mask: The characteristic, laid out as for maw32_pair_check
+// - reached: Incremented at t for every partial pair which follows the
+//            characteristic through round t + 1; rounds entries. Each is
+//            updated with a relaxed atomic store, so other threads may
+//            read it with __atomic_load_n while the search runs
+// - found: Called with M1 for every conforming pair; the search stops if it
+//          returns false
+// - arg: Passed on to found
+// - stop: If non-null, the search gives up as soon as *stop is set
+// Returns: How many conforming pairs were found
+uint64_t maw32_conform(const uint8_t *start, size_t fixed, const uint8_t *diff, size_t rounds,
+                       const uint8_t *expect, const uint8_t *mask, uint64_t *reached,
+                       bool (*found)(const uint8_t *, void *), void *arg, const int *stop);
+
+// Compute the raw MAW32 digest of the input for every round count from 1 to
+// rounds in a single pass. The first block is only run through the
+// compression function once, with the registers recorded after every round;
+// when the padded input is a single block (at most 3 bytes), this is all of
+// the work. Later blocks are chained from each round count separately.
+// Params:
+// - ptr: A non-null pointer to an array of data to hash
+// - len: The length of ptr in bytes
+// - rounds: The largest number of rounds to run
+// - states: If non-null, receives the registers (a, b, c, d) after each round
+//           of the first block, laid out as for maw32_pair_check; 4*rounds bytes
+// - digests: If non-null, receives the digest for 1, 2, ..., rounds rounds;
+//            4*rounds bytes
+void maw32_hash_sweep(const uint8_t *ptr, size_t len, size_t rounds, uint8_t *states, uint8_t *digests);
 
 // Compute the MAW32 hash of the input.
 // Params:
@@ -72,3 +206,5 @@
 //          this will be a local buffer, otherwise buf will be returned. If
 //          ptr is NULL, then NULL is returned
 char *maw32_hash(const uint8_t *ptr, size_t len, size_t rounds, char *buf);
+
+#endif // __MAW32
@@ -0,0 +1,203 @@
+// Batched implementation of MAW32.
+// Every operation in MAW32 works on single bytes, so a SIMD register can hold
+// one byte of state for many independent messages at once. Messages are
+// transposed into structure-of-arrays form (byte j of every message in one
+// vector), and each lane of the vectors then runs its own copy of the
+// compression function.
+
+#include <string.h>
+#include <stdint.h>
+#include "maw32.h"
+
+// Number of messages processed together by one call of a kernel
+#define LANES 64
+
+// A vector holding one byte from each of LANES messages. This is a GCC
+// vector extension, so the same code is lowered to two ymm registers for
+// AVX2, or to a single zmm register for AVX-512BW
+typedef uint8_t lanes_t __attribute__((vector_size(LANES)));
+
+// Constants used by every block
+static const uint8_t K[16] =
+{
+    0xb7, 0xe1, 0x51, 0x62,
+    0x8a, 0xed, 0x2a, 0x6a,
+    0xbf, 0x71, 0x58, 0x80,
+    0x9c, 0xf4, 0xf3, 0xc7
+};
+
+// MAW32 internals, across every lane
+#define ROTR(x, n)      (((x) >> (n)) | ((x) << (8 - (n))))
+#define MAJ(x, y, z)    (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SIGMA0(x)       (ROTR(x, 2) ^ ROTR(x, 3) ^ ROTR(x, 5))
+#define SIGMA1(x)       (ROTR(x, 1) ^ ROTR(x, 4) ^ ((x) >> 3))
+
+// Fetch byte pos of the padded message for every lane. Input bytes are
+// gathered from each message, while padding is the same for every lane.
+static inline __attribute__((always_inline))
+void load_byte(lanes_t *v, const uint8_t *msgs, size_t n, size_t len, size_t padded, size_t pos)
+{
+    uint8_t tmp[LANES];
+    if (pos < len)
+    {
+        size_t lane = 0;
+        for ( ; lane < n; lane++) tmp[lane] = msgs[lane * len + pos];
+        for ( ; lane < LANES; lane++) tmp[lane] = 0;
+    }
+    else
+    {
+        // The padding is a 1-bit, zeroes, then the length as a big-endian 32-bit int
+        uint32_t bits = (uint32_t)(len * 8);
+        uint8_t pad = 0x00;
+        if (pos == len) pad = 0x80;
+        else if (pos >= padded - 4) pad = bits >> (8 * (padded - 1 - pos));
+        memset(tmp, pad, LANES);
+    }
+    memcpy(v, tmp, LANES);
+}
+
+// Hash up to LANES messages of length len, writing n raw digests to out. The
+// first skip bytes of every message are the same, and have already been
+// compressed into the chaining value mid
+static inline __attribute__((always_inline))
+void hash_lanes(const uint8_t *mid, size_t skip, const uint8_t *msgs, size_t n, size_t len,
+                size_t rounds, uint8_t *out)
+{
+    // Start from the shared chaining value
+    lanes_t H[4];
+    for (int k = 0; k < 4; k++)
+    {
+        uint8_t tmp[LANES];
+        memset(tmp, mid[k], LANES);
+        memcpy(&H[k], tmp, LANES);
+    }
+
+    // Every message has the same length, so the same number of blocks
+    size_t padded = ((len + 1 + 4 + MAW32_BLOCK_SIZE - 1) / MAW32_BLOCK_SIZE) * MAW32_BLOCK_SIZE;
+    for (size_t block = skip; block < padded; block += MAW32_BLOCK_SIZE)
+    {
+        // Registers
+        lanes_t a = H[0], b = H[1], c = H[2], d = H[3];
+        // Message schedule
+        lanes_t W[16];
+
+        // Transform this block
+        for (int t = 0; t < rounds; t++)
+        {
+            if (t < 8) { load_byte(&W[t], msgs, n, len, padded, block + t); }
+            else { W[t] = SIGMA0(W[t-3]) + W[t-4] + SIGMA1(W[t-8]); }
+            lanes_t t1 = d + SIGMA1(b) + K[t] + W[t];
+            lanes_t t2 = SIGMA0(a) + MAJ(a, b, c);
+            d = c;
+            c = b + t1;
+            b = a;
+            a = t1 + t2;
+        }
+
+        // Update H
+        H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+    }
+
+    // Transpose H back into one digest per message
+    uint8_t tmp[4][LANES];
+    memcpy(tmp, H, sizeof(tmp));
+    for (size_t lane = 0; lane < n; lane++)
+    for (int k = 0; k < 4; k++)
+    {
+        out[lane * MAW32_DIGEST_SIZE + k] = tmp[k][lane];
+    }
+}
+
+// Kernels for each supported instruction set
+__attribute__((target("avx512bw")))
+static void hash_lanes_avx512bw(const uint8_t *mid, size_t skip, const uint8_t *msgs, size_t n, size_t len,
+                                size_t rounds, uint8_t *out)
+{
+    hash_lanes(mid, skip, msgs, n, len, rounds, out);
+}
+
+__attribute__((target("avx2")))
+static void hash_lanes_avx2(const uint8_t *mid, size_t skip, const uint8_t *msgs, size_t n, size_t len,
+                            size_t rounds, uint8_t *out)
+{
+    hash_lanes(mid, skip, msgs, n, len, rounds, out);
+}
+
+// Fallback for CPUs with neither; simply hashes one message at a time
+static void hash_lanes_scalar(const uint8_t *mid, size_t skip, const uint8_t *msgs, size_t n, size_t len,
+                              size_t rounds, uint8_t *out)
+{
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        struct maw32_ctx ctx;
+        maw32_init(&ctx, rounds);
+        memcpy(ctx.H, mid, MAW32_DIGEST_SIZE);
+        ctx.len = skip;
+        maw32_update(&ctx, msgs + idx * len + skip, len - skip);
+        maw32_final(&ctx, out + idx * MAW32_DIGEST_SIZE);
+    }
+}
+
+// Signature shared by every kernel
+typedef void (*kernel_t)(const uint8_t *, size_t, const uint8_t *, size_t, size_t, size_t, uint8_t *);
+
+// Supported kernels, widest first
+static const struct
+{
+    const char *name;
+    kernel_t kernel;
+} backends[] =
+{
+    { "avx512bw", hash_lanes_avx512bw },
+    { "avx2",     hash_lanes_avx2     },
+    { "scalar",   hash_lanes_scalar   },
+};
+
+// Pick the widest kernel supported by this CPU; this is only done once
+static int pick_backend()
+{
+    static int picked = -1;
+    if (picked < 0)
+    {
+        __builtin_cpu_init();
+        if      (__builtin_cpu_supports("avx512bw")) picked = 0;
+        else if (__builtin_cpu_supports("avx2"))     picked = 1;
+        else                                         picked = 2;
+    }
+    return picked;
+}
+
+// Name the kernel which maw32_hash_many uses on this CPU
+const char *maw32_many_backend()
+{
+    return backends[pick_backend()].name;
+}
+
+// Compute the raw MAW32 digests of n messages of length len, whose first
+// shared blocks are the same
+void maw32_hash_many_shared(const uint8_t *msgs, size_t n, size_t len, size_t shared,
+                            size_t rounds, uint8_t *out)
+{
+    // Ensure rounds is valid
+    if (rounds > 16) rounds = 16;
+    if (!n) return;
+
+    // Compress the shared blocks once, for every message
+    struct maw32_ctx ctx;
+    size_t skip = shared * MAW32_BLOCK_SIZE;
+    maw32_init(&ctx, rounds);
+    maw32_update(&ctx, msgs, skip);
+
+    kernel_t kernel = backends[pick_backend()].kernel;
+    for (size_t idx = 0; idx < n; idx += LANES)
+    {
+        size_t count = n - idx < LANES? n - idx : LANES;
+        kernel(ctx.H, skip, msgs + idx * len, count, len, rounds, out + idx * MAW32_DIGEST_SIZE);
+    }
+}
+
+// Compute the raw MAW32 digests of n messages of length len
+void maw32_hash_many(const uint8_t *msgs, size_t n, size_t len, size_t rounds, uint8_t *out)
+{
+    maw32_hash_many_shared(msgs, n, len, 0, rounds, out);
+}
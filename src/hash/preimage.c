@@ -0,0 +1,217 @@
+// Multithreaded brute-force search for preimages of many digests at once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sched.h>
+
+#include "util.h"
+#include "algo.h"
+#include "channel.h"
+#include "threads.h"
+#include "preimage.h"
+
+// State shared by every worker
+struct preimage_state
+{
+    const struct preimage_conf *conf;
+    uint64_t *filter;               // Bit k is set if some target's key hashes to k
+    uint32_t *set;                  // Open-addressed table of target indices plus one; 0 if free
+    uint64_t set_mask;              // Number of slots in set, less one
+    struct channel *hits;           // Preimages found; records are the target index then the input
+    uint64_t nchunks;               // How many chunks the range is split into
+    char pad0[CACHE_LINE];
+    uint64_t claimed;               // Next chunk to be claimed by a worker
+    char pad1[CACHE_LINE];
+};
+
+// State owned by a single worker
+struct preimage_worker
+{
+    pthread_t tid;
+    struct preimage_state *state;
+    uint64_t tried;                 // How many candidates have been hashed; read by the writer
+    uint64_t passed;                // How many got through the filter
+    int done;                       // Set once the worker has finished
+    char pad[CACHE_LINE];
+};
+
+// Set by ^C; tells everybody to wrap up
+static volatile sig_atomic_t interrupted = 0;
+static void on_interrupt(int sig) { interrupted = 1; }
+
+// The leading 32 bits of a digest, mixed so that they can index the filter and the set
+static inline uint64_t preimage_key(const uint8_t *digest)
+{
+    uint32_t key = ((uint32_t) digest[0] << 24) | ((uint32_t) digest[1] << 16) | ((uint32_t) digest[2] << 8) | digest[3];
+    return key * 0x9e3779b97f4a7c15ULL;
+}
+
+// Look a digest up in the set of targets
+// Returns: The index of the matching target, or -1
+static long preimage_lookup(const struct preimage_state *state, const uint8_t *digest)
+{
+    const struct preimage_conf *conf = state->conf;
+    const size_t dig = conf->algo->dig_size;
+    for (uint64_t slot = preimage_key(digest) >> 32;; slot++)
+    {
+        uint32_t entry = state->set[slot & state->set_mask];
+        if (!entry) return -1;
+        if (digest_equal(conf->targets + (entry - 1) * dig, digest, dig)) return entry - 1;
+    }
+}
+
+// Worker thread; claims chunks and checks every candidate in them
+static void *preimage_worker_main(void *arg)
+{
+    struct preimage_worker *worker = (struct preimage_worker *) arg;
+    struct preimage_state *state = worker->state;
+    const struct preimage_conf *conf = state->conf;
+    const size_t n = conf->len, dig = conf->algo->dig_size;
+    const int shift = 64 - PREIMAGE_FILTER_BITS;
+
+    uint8_t *batch = calloc((size_t) BATCH_SIZE * n + 1, 1), *digests = malloc(BATCH_SIZE * dig);
+    uint8_t *hit = malloc(sizeof(uint32_t) + n + 1);
+    while (!interrupted)
+    {
+        uint64_t seq = __atomic_fetch_add(&state->claimed, 1, __ATOMIC_RELAXED);
+        if (seq >= state->nchunks) break;
+        uint64_t first = conf->start + seq * PREIMAGE_CHUNK;
+        uint64_t end = conf->end - first < PREIMAGE_CHUNK? conf->end : first + PREIMAGE_CHUNK;
+
+        for (uint64_t base = first; base < end; base += BATCH_SIZE)
+        {
+            size_t count = end - base < BATCH_SIZE? end - base : BATCH_SIZE;
+            for (size_t idx = 0; idx < count; idx++)
+            {
+                uint8_t *input = batch + idx * n;
+                for (size_t off = 0; off < n; off++) input[n - off - 1] = off < 8? (uint8_t)((base + idx) >> (8 * off)) : 0;
+            }
+            hash_many(conf->algo, batch, count, n, conf->rounds, digests);
+
+            for (size_t idx = 0; idx < count; idx++)
+            {
+                const uint8_t *digest = digests + idx * dig;
+                uint64_t bit = preimage_key(digest) >> shift;
+                if (!(state->filter[bit / 64] >> (bit % 64) & 1)) continue;
+                worker->passed++;
+
+                long target = preimage_lookup(state, digest);
+                if (target < 0) continue;
+                uint32_t t = target;
+                memcpy(hit, &t, sizeof(uint32_t));
+                memcpy(hit + sizeof(uint32_t), batch + idx * n, n);
+                // The channel only fills up if the writer falls far behind
+                while (!channel_try_push(state->hits, hit) && !interrupted) sched_yield();
+            }
+        }
+        __atomic_store_n(&worker->tried, worker->tried + (end - first), __ATOMIC_RELAXED);
+    }
+    free(batch);
+    free(digests);
+    free(hit);
+    __atomic_store_n(&worker->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Search for preimages of every target
+void run_preimage(const struct preimage_conf *conf)
+{
+    const size_t n = conf->len, dig = conf->algo->dig_size;
+    struct preimage_state state = { conf };
+    uint64_t inputs = conf->end - conf->start;
+    state.nchunks = inputs / PREIMAGE_CHUNK + (inputs % PREIMAGE_CHUNK != 0);
+    state.hits    = channel_new(4096, sizeof(uint32_t) + n);
+    signal(SIGINT, on_interrupt);
+
+    // Build the filter, and a set with at least twice as many slots as targets
+    uint64_t slots = 1024, distinct = 0;
+    while (slots < 2 * conf->ntargets) slots *= 2;
+    state.filter   = calloc(((size_t) 1 << PREIMAGE_FILTER_BITS) / 64, sizeof(uint64_t));
+    state.set      = calloc(slots, sizeof(uint32_t));
+    state.set_mask = slots - 1;
+    for (size_t t = 0; t < conf->ntargets; t++)
+    {
+        const uint8_t *target = conf->targets + t * dig;
+        uint64_t bit = preimage_key(target) >> (64 - PREIMAGE_FILTER_BITS);
+        state.filter[bit / 64] |= (uint64_t) 1 << (bit % 64);
+        if (preimage_lookup(&state, target) >= 0) continue;
+        uint64_t slot = preimage_key(target) >> 32;
+        while (state.set[slot & state.set_mask]) slot++;
+        state.set[slot & state.set_mask] = t + 1;
+        distinct++;
+    }
+
+    struct preimage_worker *workers = calloc(conf->nthreads, sizeof(struct preimage_worker));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        workers[idx].state = &state;
+        pthread_create(&workers[idx].tid, NULL, preimage_worker_main, &workers[idx]);
+    }
+
+    // Act as the single writer: print preimages as they come in, and report progress
+    uint8_t *hit = malloc(sizeof(uint32_t) + n + 1), *found = calloc(conf->ntargets, 1);
+    char *hashbuf = malloc(2*MAX_BLOCK_SIZE + 1);
+    uint64_t preimages = 0, nfound = 0, last_tried = 0;
+    double last = now_seconds();
+    while (1)
+    {
+        // Check whether everybody has finished before draining, so no preimage is missed
+        size_t finished = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++)
+            finished += __atomic_load_n(&workers[idx].done, __ATOMIC_ACQUIRE);
+
+        bool idle = true;
+        while (channel_try_pop(state.hits, hit))
+        {
+            uint32_t t;
+            memcpy(&t, hit, sizeof(uint32_t));
+            printf("%s - ", to_hex(conf->targets + t * dig, dig, hashbuf));
+            printf("0x%s\n", to_hex(hit + sizeof(uint32_t), n, hashbuf));
+            nfound += !found[t];
+            found[t] = 1;
+            preimages++;
+            idle = false;
+        }
+        if (!idle) fflush(stdout);
+        if (finished == conf->nthreads) break;
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            uint64_t tried = 0;
+            for (size_t idx = 0; idx < conf->nthreads; idx++)
+                tried += __atomic_load_n(&workers[idx].tried, __ATOMIC_RELAXED);
+            log_line(stderr, "%llu/%llu candidates (%.3e/s), %llu/%llu targets found",
+                     (unsigned long long) tried, (unsigned long long) inputs,
+                     (tried - last_tried) / (now - last), (unsigned long long) nfound, (unsigned long long) distinct);
+            last_tried = tried;
+            last = now;
+        }
+        if (idle) sleep_ms(1);
+    }
+
+    uint64_t tried = 0, passed = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_join(workers[idx].tid, NULL);
+        tried  += workers[idx].tried;
+        passed += workers[idx].passed;
+    }
+    printf("Candidates: %llu, of which %llu passed the filter\n",
+           (unsigned long long) tried, (unsigned long long) passed);
+    printf("Preimages: %llu, covering %llu/%llu targets\n",
+           (unsigned long long) preimages, (unsigned long long) nfound, (unsigned long long) distinct);
+    fflush(stdout);
+
+    free(workers);
+    free(hit);
+    free(found);
+    free(hashbuf);
+    free(state.filter);
+    free(state.set);
+    channel_free(state.hits);
+}
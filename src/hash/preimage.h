@@ -0,0 +1,42 @@
+// Multithreaded brute-force search for preimages of many digests at once
+
+#ifndef __PREIMAGE
+#define __PREIMAGE
+
+#include <stdint.h>
+#include "algo.h"
+
+// How many consecutive candidates make up one chunk of work
+#define PREIMAGE_CHUNK (64 * BATCH_SIZE)
+
+// Bits in the filter which every digest is checked against first; 2^21 bits
+// is 256 KiB, small enough to stay in cache
+#define PREIMAGE_FILTER_BITS 21
+
+// Configuration of a preimage search
+struct preimage_conf
+{
+    const struct hash_algo *algo;   // Algorithm being attacked
+    size_t rounds;                  // How many rounds of the algorithm to run
+    const uint8_t *targets;         // Digests being searched for; ntargets of algo->dig_size bytes
+    size_t ntargets;                // How many targets there are
+    size_t len;                     // Length of every candidate, in bytes
+    uint64_t start, end;            // Range of candidate indices to try, end exclusive
+    size_t nthreads;                // How many worker threads to run
+};
+
+// Hash every candidate of length len whose index lies in [start, end), where
+// candidate i is the big-endian encoding of i, and look for those whose
+// digest is one of the targets. Workers claim chunks of PREIMAGE_CHUNK
+// consecutive candidates in turn, and hash them with the batch engine. Each
+// digest is first checked against a bitmap filter of the targets, which
+// rejects nearly every candidate without leaving the cache; only those which
+// pass are looked up in a hash set of the targets.
+// Every preimage is printed to stdout as "digest - 0xinput" as it is found,
+// and progress is reported to stderr. When the range is exhausted, or the
+// search is interrupted with ^C, the number of targets found is printed.
+// Params:
+// - conf: Configuration of the search
+void run_preimage(const struct preimage_conf *conf);
+
+#endif // __PREIMAGE
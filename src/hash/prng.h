@@ -0,0 +1,136 @@
+// Fast PRNG for generating inputs: xoshiro256** (Blackman & Vigna), seeded
+// with splitmix64. Unlike rand(), every generator has its own state, so each
+// thread can own an independent stream. Bulk fills run PRNG_LANES further
+// copies of the generator side by side in a vector, producing 32 bytes per step.
+
+#ifndef __PRNG
+#define __PRNG
+
+#include <string.h>
+#include <stdint.h>
+
+// Number of generators run side by side by prng_fill
+#define PRNG_LANES 4
+
+// One word of state from each of the PRNG_LANES generators
+typedef uint64_t prng_v __attribute__((vector_size(8 * PRNG_LANES)));
+
+// State of a single generator. The lanes are kept as plain words, as the
+// struct may not be aligned well enough for vector loads
+struct prng
+{
+    uint64_t s[4];                  // Scalar generator, for single values
+    uint64_t v[4][PRNG_LANES];      // Vector generators, for filling buffers
+};
+
+// Left-rotate a 64-bit word
+static inline uint64_t prng_rotl(uint64_t x, int n)
+{
+    return (x << n) | (x >> (64 - n));
+}
+
+// Seed a generator from a single 64-bit value
+static inline void prng_seed(struct prng *rng, uint64_t seed)
+{
+    // splitmix64 spreads the seed across the whole state, and never gives an all-zero state
+    for (int i = 0; i < 4 + 4 * PRNG_LANES; i++)
+    {
+        uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        if (i < 4) rng->s[i] = z ^ (z >> 31);
+        else       rng->v[(i - 4) / PRNG_LANES][(i - 4) % PRNG_LANES] = z ^ (z >> 31);
+    }
+}
+
+// Produce the next 64 random bits
+static inline uint64_t prng_next(struct prng *rng)
+{
+    uint64_t *s = rng->s;
+    const uint64_t result = prng_rotl(s[1] * 5, 7) * 9;
+    const uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = prng_rotl(s[3], 45);
+    return result;
+}
+
+// Step every vector generator at once, returning 64 random bits from each.
+// The multiplications by 5 and 9 are done with shifts, which vectorise
+static inline prng_v prng_next_v(prng_v *s)
+{
+    const prng_v x = s[1] + (s[1] << 2);
+    const prng_v result = ((x << 7) | (x >> 57)) + (((x << 7) | (x >> 57)) << 3);
+    const prng_v t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return result;
+}
+
+// Advance a generator by 2^128 outputs. Seeding one generator, then copying
+// it and jumping once per thread, gives every thread a non-overlapping stream
+static inline void prng_jump(struct prng *rng)
+{
+    static const uint64_t JUMP[] = 
+    {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    };
+    uint64_t s[4] = { 0, 0, 0, 0 };
+    prng_v v[4], acc[4] = { { 0 } };
+    memcpy(v, rng->v, sizeof(v));
+    for (int i = 0; i < 4; i++)
+    for (int b = 0; b < 64; b++)
+    {
+        if (JUMP[i] & (1ULL << b))
+        {
+            s[0] ^= rng->s[0]; s[1] ^= rng->s[1]; s[2] ^= rng->s[2]; s[3] ^= rng->s[3];
+            acc[0] ^= v[0]; acc[1] ^= v[1]; acc[2] ^= v[2]; acc[3] ^= v[3];
+        }
+        prng_next(rng);
+        prng_next_v(v);
+    }
+    memcpy(rng->s, s, sizeof(s));
+    memcpy(rng->v, acc, sizeof(acc));
+}
+
+// Fill len bytes of buf with random data, using the vector generators for
+// as much as possible and the scalar one for the rest
+static inline void prng_fill(struct prng *rng, uint8_t *buf, size_t len)
+{
+    if (len >= sizeof(prng_v))
+    {
+        prng_v v[4];
+        memcpy(v, rng->v, sizeof(v));
+        for ( ; len >= sizeof(prng_v); buf += sizeof(prng_v), len -= sizeof(prng_v))
+        {
+            prng_v x = prng_next_v(v);
+            memcpy(buf, &x, sizeof(x));
+        }
+        memcpy(rng->v, v, sizeof(v));
+    }
+    for ( ; len >= 8; buf += 8, len -= 8)
+    {
+        uint64_t x = prng_next(rng);
+        memcpy(buf, &x, 8);
+    }
+    if (len)
+    {
+        uint64_t x = prng_next(rng);
+        memcpy(buf, &x, len);
+    }
+}
+
+// Produce a random value in [0, bound), without modulo bias for small bounds
+static inline uint32_t prng_below(struct prng *rng, uint32_t bound)
+{
+    return (uint32_t)(((prng_next(rng) >> 32) * bound) >> 32);
+}
+
+#endif // __PRNG
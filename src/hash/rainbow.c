@@ -0,0 +1,442 @@
+// Rainbow tables for inverting short inputs, built and searched in parallel
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "util.h"
+#include "algo.h"
+#include "channel.h"
+#include "threads.h"
+#include "rainbow.h"
+
+// Where the entries start in a table file
+#define RAINBOW_ENTRIES (sizeof(struct rainbow_header) + (RAINBOW_INDEX + 1) * sizeof(uint64_t))
+
+// State shared by every worker of a build or a lookup
+struct rainbow_state
+{
+    const struct hash_algo *algo;
+    size_t rounds, len;             // As in the table's header
+    uint32_t length, mask;          // Steps in each chain, and the bits of an input
+    uint64_t *index, *entries;      // The table's index and entries, in the mapped file
+    uint64_t chains;                // How many chains are built, or how many entries there are to search
+    uint64_t first;                 // Chain at the start of the first chunk still to build
+    uint64_t nchunks;               // How many chunks of chains, or groups of targets, there are
+    uint8_t *done;                  // Set for every chunk or group once it is finished
+    const uint8_t *targets;         // Digests being inverted, in a lookup
+    size_t ntargets;
+    uint32_t *preimages;            // Preimage of every target, if found is set
+    uint8_t *found;
+    char pad0[CACHE_LINE];
+    uint64_t claimed;               // Next chunk or group to be claimed by a worker
+    char pad1[CACHE_LINE];
+};
+
+// Set by ^C; tells everybody to wrap up
+static volatile sig_atomic_t interrupted = 0;
+static void on_interrupt(int sig) { interrupted = 1; }
+
+// The leading 32 bits of a digest
+static inline uint32_t rainbow_key(const uint8_t *digest)
+{
+    return ((uint32_t) digest[0] << 24) | ((uint32_t) digest[1] << 16) | ((uint32_t) digest[2] << 8) | digest[3];
+}
+
+// Reduce a digest's key to the input taken by the next step of a chain. Each
+// step mixes in its own constant, so chains only merge if they collide at the
+// same step
+static inline uint32_t rainbow_reduce(uint32_t key, uint32_t step, uint32_t mask)
+{
+    uint64_t z = key + (step + 1) * 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31)) & mask;
+}
+
+// Write input x as a len-byte big-endian integer
+static inline void rainbow_input(uint32_t x, uint8_t *buf, size_t len)
+{
+    for (size_t off = 0; off < len; off++) buf[len - off - 1] = x >> (8 * off);
+}
+
+// Step every input in xs through the given steps of a chain together
+static void rainbow_steps(const struct rainbow_state *state, uint32_t *xs, size_t n, uint32_t from, uint32_t to,
+                          uint8_t *msgs, uint8_t *digests)
+{
+    const size_t len = state->len, dig = state->algo->dig_size;
+    for (uint32_t step = from; step < to; step++)
+    {
+        for (size_t idx = 0; idx < n; idx++) rainbow_input(xs[idx], msgs + idx * len, len);
+        hash_many(state->algo, msgs, n, len, state->rounds, digests);
+        for (size_t idx = 0; idx < n; idx++) xs[idx] = rainbow_reduce(rainbow_key(digests + idx * dig), step, state->mask);
+    }
+}
+
+// Which bucket of the index an endpoint falls in
+static inline uint32_t rainbow_bucket(uint32_t end, size_t len)
+{
+    return ((uint64_t) end << (32 - 8 * len)) >> 16;
+}
+
+// Worker thread for a build; claims chunks of chains and builds them
+static void *rainbow_build_main(void *arg)
+{
+    struct rainbow_state *state = (struct rainbow_state *) arg;
+    uint32_t xs[BATCH_SIZE];
+    uint8_t *msgs = malloc(BATCH_SIZE * state->len + 1), *digests = malloc(BATCH_SIZE * state->algo->dig_size);
+    while (!interrupted)
+    {
+        uint64_t seq = __atomic_fetch_add(&state->claimed, 1, __ATOMIC_RELAXED);
+        if (seq >= state->nchunks) break;
+        uint64_t first = state->first + seq * RAINBOW_CHUNK;
+        uint64_t end = state->chains - first < RAINBOW_CHUNK? state->chains : first + RAINBOW_CHUNK;
+
+        for (uint64_t base = first; base < end && !interrupted; base += BATCH_SIZE)
+        {
+            size_t count = end - base < BATCH_SIZE? end - base : BATCH_SIZE;
+            for (size_t idx = 0; idx < count; idx++) xs[idx] = base + idx;
+            rainbow_steps(state, xs, count, 0, state->length, msgs, digests);
+            for (size_t idx = 0; idx < count; idx++) state->entries[base + idx] = ((uint64_t) xs[idx] << 32) | (base + idx);
+        }
+        if (!interrupted) __atomic_store_n(&state->done[seq], 1, __ATOMIC_RELEASE);
+    }
+    free(msgs);
+    free(digests);
+    return NULL;
+}
+
+// Sort the entries by endpoint, drop all but the first chain to reach each
+// endpoint, and fill in the index
+// Returns: How many entries remain
+static uint64_t rainbow_finish(uint64_t *index, uint64_t *entries, uint64_t chains, size_t len)
+{
+    // A stable radix sort on the endpoint, a byte at a time, keeps the chains
+    // reaching each endpoint in order of their starts
+    uint64_t *tmp = malloc(chains * sizeof(uint64_t)), *src = entries, *dst = tmp;
+    for (size_t pass = 0; pass < len; pass++)
+    {
+        const int shift = 32 + 8 * pass;
+        uint64_t offs[256] = { 0 };
+        for (uint64_t idx = 0; idx < chains; idx++) offs[(src[idx] >> shift) & 0xff]++;
+        for (uint64_t b = 0, sum = 0; b < 256; b++)
+        {
+            uint64_t count = offs[b];
+            offs[b] = sum;
+            sum += count;
+        }
+        for (uint64_t idx = 0; idx < chains; idx++) dst[offs[(src[idx] >> shift) & 0xff]++] = src[idx];
+        uint64_t *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    uint64_t kept = 0;
+    for (uint64_t idx = 0; idx < chains; idx++)
+    {
+        if (kept && entries[kept - 1] >> 32 == src[idx] >> 32) continue;
+        entries[kept++] = src[idx];
+    }
+    free(tmp);
+
+    for (uint64_t idx = 0, bucket = 0; bucket <= RAINBOW_INDEX; bucket++)
+    {
+        while (idx < kept && rainbow_bucket(entries[idx] >> 32, len) < bucket) idx++;
+        index[bucket] = idx;
+    }
+    return kept;
+}
+
+// Build a rainbow table, carrying on from an earlier build if there is one
+bool run_rainbow(const struct rainbow_conf *conf)
+{
+    const struct hash_algo *algo = conf->algo;
+    int fd = open(conf->path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "%s: %s\n", conf->path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return false;
+    }
+
+    // Start a new table, or check that the existing one was started with the same parameters
+    struct rainbow_header header = { RAINBOW_MAGIC };
+    const size_t size = RAINBOW_ENTRIES + conf->chains * sizeof(uint64_t);
+    if (st.st_size == 0)
+    {
+        strncpy(header.algo, algo->name, sizeof(header.algo));
+        header.rounds = conf->rounds;
+        header.len    = conf->len;
+        header.length = conf->length;
+        header.chains = conf->chains;
+        if (ftruncate(fd, size) < 0 || pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            fprintf(stderr, "%s: %s\n", conf->path, strerror(errno));
+            close(fd);
+            return false;
+        }
+    }
+    else if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, RAINBOW_MAGIC, 8) ||
+             strncmp(header.algo, algo->name, sizeof(header.algo)) || header.rounds != conf->rounds ||
+             header.len != conf->len || header.length != conf->length || header.chains != conf->chains)
+    {
+        fprintf(stderr, "%s: Not a table with the same parameters\n", conf->path);
+        close(fd);
+        return false;
+    }
+    if (header.sorted)
+    {
+        fprintf(stderr, "%s: Table is already complete\n", conf->path);
+        close(fd);
+        return true;
+    }
+    if (header.built) fprintf(stderr, "Carrying on from chain %llu\n", (unsigned long long) header.built);
+
+    uint8_t *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: %s\n", conf->path, strerror(errno));
+        return false;
+    }
+    struct rainbow_header *mapped = (struct rainbow_header *) map;
+
+    struct rainbow_state state = { algo, conf->rounds, conf->len, conf->length };
+    state.mask    = conf->len == 4? UINT32_MAX : ((uint32_t) 1 << (8 * conf->len)) - 1;
+    state.index   = (uint64_t *) (map + sizeof(struct rainbow_header));
+    state.entries = (uint64_t *) (map + RAINBOW_ENTRIES);
+    state.chains  = conf->chains;
+    state.first   = header.built;
+    state.nchunks = (conf->chains - header.built + RAINBOW_CHUNK - 1) / RAINBOW_CHUNK;
+    state.done    = calloc(state.nchunks + 1, 1);
+    signal(SIGINT, on_interrupt);
+
+    pthread_t *tids = calloc(conf->nthreads, sizeof(pthread_t));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_create(&tids[idx], NULL, rainbow_build_main, &state);
+    }
+
+    // Record how far the build has got as chunks finish, so that it can be resumed
+    uint64_t next = 0, last_built = header.built;
+    double last = now_seconds();
+    while (next < state.nchunks && !interrupted)
+    {
+        while (next < state.nchunks && __atomic_load_n(&state.done[next], __ATOMIC_ACQUIRE)) next++;
+        uint64_t built = state.first + next * RAINBOW_CHUNK;
+        mapped->built = built < conf->chains? built : conf->chains;
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            msync(map, sizeof(struct rainbow_header), MS_ASYNC);
+            log_line(stderr, "%llu/%llu chains (%.3e steps/s)", (unsigned long long) mapped->built,
+                     (unsigned long long) conf->chains, (double) (mapped->built - last_built) * conf->length / (now - last));
+            last_built = mapped->built;
+            last = now;
+        }
+        sleep_ms(10);
+    }
+    for (size_t idx = 0; idx < conf->nthreads; idx++) pthread_join(tids[idx], NULL);
+    free(tids);
+    free(state.done);
+
+    bool complete = mapped->built == conf->chains;
+    if (complete)
+    {
+        mapped->entries = rainbow_finish(state.index, state.entries, conf->chains, conf->len);
+        mapped->sorted  = 1;
+        printf("Chains: %llu of %u steps, %llu distinct endpoints\n", (unsigned long long) conf->chains,
+               conf->length, (unsigned long long) mapped->entries);
+    }
+    else fprintf(stderr, "Stopped after %llu chains; run again to carry on\n", (unsigned long long) mapped->built);
+    uint64_t entries = mapped->entries;
+    msync(map, size, MS_SYNC);
+    munmap(map, size);
+
+    // Merged chains no longer take up space
+    if (complete && truncate(conf->path, RAINBOW_ENTRIES + entries * sizeof(uint64_t)) < 0)
+    {
+        fprintf(stderr, "%s: %s\n", conf->path, strerror(errno));
+    }
+    return complete;
+}
+
+// Find the start of the chain ending at end
+// Returns: Whether there is one
+static bool rainbow_find(const struct rainbow_state *state, uint32_t end, uint32_t *start)
+{
+    uint32_t bucket = rainbow_bucket(end, state->len);
+    uint64_t lo = state->index[bucket], hi = state->index[bucket + 1];
+    while (lo < hi)
+    {
+        uint64_t mid = lo + (hi - lo) / 2;
+        uint32_t seen = state->entries[mid] >> 32;
+        if (seen == end)
+        {
+            *start = state->entries[mid];
+            return true;
+        }
+        if (seen < end) lo = mid + 1;
+        else            hi = mid;
+    }
+    return false;
+}
+
+// Worker thread for a lookup; claims groups of targets and searches for them
+static void *rainbow_lookup_main(void *arg)
+{
+    struct rainbow_state *state = (struct rainbow_state *) arg;
+    const size_t len = state->len, dig = state->algo->dig_size;
+    uint32_t xs[BATCH_SIZE], pending[BATCH_SIZE];
+    uint8_t *msgs = malloc(BATCH_SIZE * len + 1), *digests = malloc(BATCH_SIZE * dig);
+    uint8_t input[MAX_BLOCK_SIZE], digest[MAX_BLOCK_SIZE];
+    while (!interrupted)
+    {
+        uint64_t seq = __atomic_fetch_add(&state->claimed, 1, __ATOMIC_RELAXED);
+        if (seq >= state->nchunks) break;
+        size_t first = seq * BATCH_SIZE, count = state->ntargets - first < BATCH_SIZE? state->ntargets - first : BATCH_SIZE;
+        size_t npending = count;
+        for (size_t idx = 0; idx < count; idx++) pending[idx] = first + idx;
+
+        // Try every position in the chain for every target not yet found,
+        // starting from the end where the fewest steps are needed
+        for (uint32_t pos = state->length; pos-- && npending && !interrupted;)
+        {
+            for (size_t idx = 0; idx < npending; idx++)
+                xs[idx] = rainbow_reduce(rainbow_key(state->targets + pending[idx] * dig), pos, state->mask);
+            rainbow_steps(state, xs, npending, pos + 1, state->length, msgs, digests);
+
+            size_t kept = 0;
+            for (size_t idx = 0; idx < npending; idx++)
+            {
+                const uint8_t *target = state->targets + pending[idx] * dig;
+                uint32_t x;
+                if (rainbow_find(state, xs[idx], &x))
+                {
+                    // Rebuild the chain up to this position; the endpoint may also have been a false alarm
+                    rainbow_steps(state, &x, 1, 0, pos, msgs, digests);
+                    rainbow_input(x, input, len);
+                    state->algo->hash_raw(input, len, state->rounds, digest);
+                    if (digest_equal(digest, target, dig))
+                    {
+                        state->preimages[pending[idx]] = x;
+                        state->found[pending[idx]] = 1;
+                        continue;
+                    }
+                }
+                pending[kept++] = pending[idx];
+            }
+            npending = kept;
+        }
+        if (!interrupted) __atomic_store_n(&state->done[seq], 1, __ATOMIC_RELEASE);
+    }
+    free(msgs);
+    free(digests);
+    return NULL;
+}
+
+// Search a rainbow table for preimages of every target
+long run_rainbow_lookup(const struct rainbow_lookup_conf *conf)
+{
+    const struct hash_algo *algo = conf->algo;
+    int fd = open(conf->path, O_RDONLY);
+    struct stat st;
+    struct rainbow_header header;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "%s: %s\n", conf->path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, RAINBOW_MAGIC, 8) ||
+        !header.sorted || st.st_size < RAINBOW_ENTRIES + header.entries * sizeof(uint64_t))
+    {
+        fprintf(stderr, "%s: Not a complete table\n", conf->path);
+        close(fd);
+        return -1;
+    }
+    if (strncmp(header.algo, algo->name, sizeof(header.algo)))
+    {
+        fprintf(stderr, "%s: Table was built for %.16s\n", conf->path, header.algo);
+        close(fd);
+        return -1;
+    }
+    uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: %s\n", conf->path, strerror(errno));
+        return -1;
+    }
+
+    struct rainbow_state state = { algo, header.rounds, header.len, header.length };
+    state.mask      = header.len == 4? UINT32_MAX : ((uint32_t) 1 << (8 * header.len)) - 1;
+    state.index     = (uint64_t *) (map + sizeof(struct rainbow_header));
+    state.entries   = (uint64_t *) (map + RAINBOW_ENTRIES);
+    state.chains    = header.entries;
+    state.nchunks   = (conf->ntargets + BATCH_SIZE - 1) / BATCH_SIZE;
+    state.done      = calloc(state.nchunks + 1, 1);
+    state.targets   = conf->targets;
+    state.ntargets  = conf->ntargets;
+    state.preimages = calloc(conf->ntargets, sizeof(uint32_t));
+    state.found     = calloc(conf->ntargets, 1);
+    signal(SIGINT, on_interrupt);
+
+    pthread_t *tids = calloc(conf->nthreads, sizeof(pthread_t));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_create(&tids[idx], NULL, rainbow_lookup_main, &state);
+    }
+
+    // Print the preimages of each group of targets in order, as soon as it and every group before it are done
+    char hashbuf[2*MAX_BLOCK_SIZE + 1];
+    uint8_t input[MAX_BLOCK_SIZE];
+    uint64_t next = 0;
+    long found = 0;
+    double last = now_seconds();
+    while (next < state.nchunks && !interrupted)
+    {
+        if (!__atomic_load_n(&state.done[next], __ATOMIC_ACQUIRE))
+        {
+            double now = now_seconds();
+            if (now - last >= STATUS_INTERVAL)
+            {
+                log_line(stderr, "%llu/%zu targets searched, %ld found", (unsigned long long) (next * BATCH_SIZE),
+                         conf->ntargets, found);
+                last = now;
+            }
+            sleep_ms(1);
+            continue;
+        }
+        size_t end = (next + 1) * BATCH_SIZE < conf->ntargets? (next + 1) * BATCH_SIZE : conf->ntargets;
+        for (size_t t = next * BATCH_SIZE; t < end; t++)
+        {
+            if (!state.found[t]) continue;
+            rainbow_input(state.preimages[t], input, header.len);
+            printf("%s - ", to_hex(conf->targets + t * algo->dig_size, algo->dig_size, hashbuf));
+            printf("0x%s\n", to_hex(input, header.len, hashbuf));
+            found++;
+        }
+        next++;
+    }
+    for (size_t idx = 0; idx < conf->nthreads; idx++) pthread_join(tids[idx], NULL);
+    printf("Found: %ld/%zu\n", found, conf->ntargets);
+    fflush(stdout);
+
+    free(tids);
+    free(state.done);
+    free(state.preimages);
+    free(state.found);
+    munmap(map, st.st_size);
+    return found;
+}
@@ -0,0 +1,89 @@
+// Rainbow tables for inverting short inputs, built and searched in parallel.
+// A table file starts with a 64-byte header, followed by an index of
+// RAINBOW_INDEX + 1 64-bit offsets, then one 64-bit entry per chain holding
+// its endpoint in the top 32 bits and its start in the bottom 32. Once built,
+// the entries are sorted by endpoint with duplicates removed, and index[k] is
+// the first entry whose endpoint lies in bucket k, so that the file can be
+// mmapped and searched directly. Everything is stored in the byte order of
+// the machine which built the table.
+
+#ifndef __RAINBOW
+#define __RAINBOW
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "algo.h"
+
+#define RAINBOW_MAGIC "HASHRBW1"
+
+// Number of buckets in the endpoint index
+#define RAINBOW_INDEX (1 << 16)
+
+// How many consecutive chains make up one chunk of work
+#define RAINBOW_CHUNK (16 * BATCH_SIZE)
+
+// File header; exactly 64 bytes
+struct rainbow_header
+{
+    char magic[8];                  // RAINBOW_MAGIC, without a terminator
+    char algo[16];                  // Name of the algorithm, zero-padded
+    uint32_t rounds;                // How many rounds every digest is computed with
+    uint32_t len;                   // Length of every input, at most 4 bytes
+    uint32_t length;                // How many steps make up each chain
+    uint32_t sorted;                // Set once the entries have been sorted and indexed
+    uint64_t chains;                // How many chains are built; chain j starts at input j
+    uint64_t built;                 // Chains before this one have all been built
+    uint64_t entries;               // How many entries remain once sorted
+};
+
+// Configuration of a table build
+struct rainbow_conf
+{
+    const struct hash_algo *algo;   // Algorithm being inverted
+    size_t rounds;                  // How many rounds of the algorithm to run
+    size_t len;                     // Length of every input, in bytes
+    uint64_t chains;                // How many chains to build
+    uint32_t length;                // How many steps make up each chain
+    const char *path;               // Where the table is stored
+    size_t nthreads;                // How many worker threads to run
+};
+
+// Configuration of a table lookup
+struct rainbow_lookup_conf
+{
+    const struct hash_algo *algo;   // Algorithm being inverted; must match the table's
+    const char *path;               // Where the table is stored
+    const uint8_t *targets;         // Digests being inverted; ntargets of algo->dig_size bytes
+    size_t ntargets;                // How many targets there are
+    size_t nthreads;                // How many worker threads to run
+};
+
+// Build a rainbow table. Chain j starts at the input whose big-endian
+// encoding is j; each step hashes the input, then reduces the leading 32
+// bits of the digest to a new input with a function which differs at every
+// step. Workers claim chunks of RAINBOW_CHUNK chains in turn, and step every
+// chain of a batch together through the batch engine, writing the endpoints
+// straight into the mmapped file. How far the build has got is kept in the
+// header, so an interrupted build carries on where it stopped when run again
+// with the same parameters. Once every chain is built, the entries are
+// sorted by endpoint, chains which merged are dropped, and the index is filled
+// in.
+// Params:
+// - conf: Configuration of the build
+// Returns: Whether the table is complete
+bool run_rainbow(const struct rainbow_conf *conf);
+
+// Search a rainbow table for preimages of every target. Workers claim groups
+// of up to BATCH_SIZE targets, and for each position in the chain step every
+// target of the group which is still unsolved to the end of the chain
+// together through the batch engine, looking the results up in the table.
+// Any chain found is rebuilt from its start to recover the preimage, which is
+// checked against the full digest. Preimages are printed to stdout as
+// "digest - 0xinput" in the order of the targets, followed by the number
+// found. Progress is reported to stderr.
+// Params:
+// - conf: Configuration of the lookup
+// Returns: How many targets were found, or -1 if the table could not be used
+long run_rainbow_lookup(const struct rainbow_lookup_conf *conf);
+
+#endif // __RAINBOW
@@ -0,0 +1,67 @@
+// Binary output format for sample and iterate.
+// A file starts with a 64-byte header, followed by fixed-size records, so
+// that it can be mmapped and indexed directly. Each record holds:
+// - The input length in bytes, as a little-endian 32-bit int
+// - The input, zero-padded out to max_len bytes
+// - The raw digest
+// All header fields are little-endian as well.
+
+#ifndef __RECORDS
+#define __RECORDS
+
+#include <string.h>
+#include <stdint.h>
+#include "algo.h"
+
+#define RECORD_MAGIC "HASHREC1"
+
+// File header; exactly 64 bytes
+struct record_header
+{
+    char magic[8];                  // RECORD_MAGIC, without a terminator
+    char algo[16];                  // Name of the algorithm, zero-padded
+    uint32_t max_len;               // Space reserved for the input in every record
+    uint32_t dig_size;              // Size of the digest in every record
+    uint32_t rec_size;              // Size of every record; 4 + max_len + dig_size
+    uint32_t rounds;                // How many rounds the digests were computed with
+    uint8_t reserved[24];
+};
+
+// Store a 32-bit int as little-endian
+static inline void put_le32(uint8_t *out, uint32_t x)
+{
+    out[0] = x; out[1] = x >> 8; out[2] = x >> 16; out[3] = x >> 24;
+}
+
+// Size of each record for inputs of at most max_len bytes
+static inline size_t record_size(const struct hash_algo *algo, size_t max_len)
+{
+    return 4 + max_len + algo->dig_size;
+}
+
+// Fill in the header for a file of records
+static inline void record_header_init(struct record_header *header, const struct hash_algo *algo,
+                                      size_t max_len, size_t rounds)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, RECORD_MAGIC, 8);
+    strncpy(header->algo, algo->name, sizeof(header->algo));
+    put_le32((uint8_t *) &header->max_len,  max_len);
+    put_le32((uint8_t *) &header->dig_size, algo->dig_size);
+    put_le32((uint8_t *) &header->rec_size, record_size(algo, max_len));
+    put_le32((uint8_t *) &header->rounds,   rounds > algo->max_rounds? algo->max_rounds : rounds);
+}
+
+// Write a single record into out
+// Returns: A pointer just past the record
+static inline uint8_t *put_record(uint8_t *out, const struct hash_algo *algo, size_t max_len,
+                                  const uint8_t *input, size_t len, const uint8_t *digest)
+{
+    put_le32(out, len);
+    memcpy(out + 4, input, len);
+    memset(out + 4 + len, 0, max_len - len);
+    memcpy(out + 4 + max_len, digest, algo->dig_size);
+    return out + record_size(algo, max_len);
+}
+
+#endif // __RECORDS
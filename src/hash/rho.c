@@ -0,0 +1,336 @@
+// Multithreaded generic collision search with Pollard's rho and
+// distinguished points
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <sched.h>
+#include <math.h>
+
+#include "util.h"
+#include "algo.h"
+#include "prng.h"
+#include "channel.h"
+#include "threads.h"
+#include "rho.h"
+
+// Most entries the table of distinguished points may have
+#define RHO_MAX_TABLE (1 << 24)
+
+// A distinguished point, and the walk which reached it
+struct rho_entry
+{
+    uint64_t key;                   // The point plus one, or 0 if the slot is free
+    uint64_t start;                 // Where the walk started
+    uint64_t len;                   // How many steps the walk took
+    int ready;                      // Set once start and len have been written
+};
+
+// State shared by every worker
+struct rho_state
+{
+    const struct rho_conf *conf;
+    struct rho_entry *table;        // Open-addressed table of distinguished points
+    uint64_t table_mask;            // Number of slots, less one
+    uint64_t table_limit;           // Points are no longer stored once this many are
+    struct channel *hits;           // Collisions found; records are two points
+    char pad0[CACHE_LINE];
+    uint64_t stored;                // How many distinguished points are in the table
+    char pad1[CACHE_LINE];
+    int stop;                       // Set once enough collisions have been found
+    char pad2[CACHE_LINE];
+};
+
+// State owned by a single worker
+struct rho_worker
+{
+    pthread_t tid;
+    struct rho_state *state;
+    struct prng rng;                // This worker's PRNG stream, for starting walks
+    uint64_t steps;                 // How many points have been hashed; read by the writer
+    uint64_t merges;                // Walks which ran into a stored point
+    uint64_t robin_hoods;           // Merges which began on the other walk, so found nothing
+    uint64_t abandoned;             // Walks which ran too long, likely stuck in a cycle
+    int done;                       // Set once the worker has finished
+    char pad[CACHE_LINE];
+};
+
+// Set by ^C; tells everybody to wrap up
+static volatile sig_atomic_t interrupted = 0;
+static void on_interrupt(int sig) { interrupted = 1; }
+
+// Write the message for point x
+static inline void rho_message(uint64_t x, uint8_t *msg, size_t len)
+{
+    for (size_t idx = 0; idx < len; idx++) msg[idx] = x >> (8 * (len - 1 - idx));
+}
+
+// The point following a digest: its leading bits, as an integer
+static inline uint64_t rho_point(const uint8_t *digest, size_t dig, uint32_t bits)
+{
+    size_t nbytes = dig < 8? dig : 8;
+    uint64_t x = 0;
+    for (size_t idx = 0; idx < nbytes; idx++) x = (x << 8) | digest[idx];
+    return x >> (8 * nbytes - bits);
+}
+
+// Take a single step of a walk by itself
+static uint64_t rho_step(const struct rho_conf *conf, uint64_t x, uint8_t *digest)
+{
+    uint8_t msg[MAX_BLOCK_SIZE];
+    const size_t len = (conf->bits + 7) / 8;
+    rho_message(x, msg, len);
+    conf->algo->hash_raw(msg, len, conf->rounds, digest);
+    return rho_point(digest, conf->algo->dig_size, conf->bits);
+}
+
+// Store a distinguished point reached by a walk, unless it is already stored
+// Returns: The entry for a walk which reached the same point first, or NULL
+static struct rho_entry *rho_insert(struct rho_state *state, uint64_t point, uint64_t start, uint64_t len)
+{
+    const uint64_t key = point + 1;
+    bool full = __atomic_load_n(&state->stored, __ATOMIC_RELAXED) >= state->table_limit;
+    for (uint64_t slot = (point * 0x9e3779b97f4a7c15ULL) >> 20;; slot++)
+    {
+        struct rho_entry *entry = &state->table[slot & state->table_mask];
+        uint64_t seen = __atomic_load_n(&entry->key, __ATOMIC_ACQUIRE);
+        if (!seen)
+        {
+            // Once the table is full, points are only looked up
+            if (full) return NULL;
+            if (!__atomic_compare_exchange_n(&entry->key, &seen, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                // Somebody else claimed the slot first; look at what they put there
+                slot--;
+                continue;
+            }
+            entry->start = start;
+            entry->len   = len;
+            __atomic_store_n(&entry->ready, 1, __ATOMIC_RELEASE);
+            __atomic_fetch_add(&state->stored, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        if (seen == key)
+        {
+            while (!__atomic_load_n(&entry->ready, __ATOMIC_ACQUIRE)) sched_yield();
+            return entry;
+        }
+    }
+}
+
+// Retrace two walks which reached the same distinguished point from their
+// starts, and find the pair of points where they merged
+// Returns: Whether the walks merged anywhere but at one of their starts
+static bool rho_locate(const struct rho_conf *conf, uint64_t x, uint64_t x_len, uint64_t y, uint64_t y_len,
+                       uint64_t *pair)
+{
+    uint8_t digest[MAX_BLOCK_SIZE];
+    // Line the walks up, so that both are the same number of steps from the end
+    for (; x_len > y_len; x_len--) x = rho_step(conf, x, digest);
+    for (; y_len > x_len; y_len--) y = rho_step(conf, y, digest);
+    if (x == y) return false;
+
+    while (x_len--)
+    {
+        uint64_t next_x = rho_step(conf, x, digest), next_y = rho_step(conf, y, digest);
+        if (next_x == next_y)
+        {
+            pair[0] = x < y? x : y;
+            pair[1] = x < y? y : x;
+            return true;
+        }
+        x = next_x;
+        y = next_y;
+    }
+    return false;
+}
+
+// Worker thread; runs RHO_WALKS walks side by side until the search stops
+static void *rho_worker_main(void *arg)
+{
+    struct rho_worker *worker = (struct rho_worker *) arg;
+    struct rho_state *state = worker->state;
+    const struct rho_conf *conf = state->conf;
+    const size_t len = (conf->bits + 7) / 8, dig = conf->algo->dig_size;
+    const uint64_t point_mask = ((uint64_t) 1 << conf->bits) - 1;
+    const uint64_t dp_mask = ((uint64_t) 1 << conf->dp_bits) - 1;
+    // Walks this long have most likely fallen into a cycle with no distinguished point
+    const uint64_t max_len = (uint64_t) 20 << conf->dp_bits;
+
+    uint64_t start[RHO_WALKS], cur[RHO_WALKS], steps[RHO_WALKS], pair[2];
+    uint8_t *msgs = malloc(RHO_WALKS * len), *digests = malloc(RHO_WALKS * dig);
+    for (size_t w = 0; w < RHO_WALKS; w++)
+    {
+        start[w] = cur[w] = prng_next(&worker->rng) & point_mask;
+        steps[w] = 0;
+    }
+
+    while (!__atomic_load_n(&state->stop, __ATOMIC_RELAXED) && !interrupted)
+    {
+        // Take one step of every walk through the batch engine
+        for (size_t w = 0; w < RHO_WALKS; w++) rho_message(cur[w], msgs + w * len, len);
+        hash_many(conf->algo, msgs, RHO_WALKS, len, conf->rounds, digests);
+        __atomic_store_n(&worker->steps, worker->steps + RHO_WALKS, __ATOMIC_RELAXED);
+
+        for (size_t w = 0; w < RHO_WALKS; w++)
+        {
+            uint64_t next = rho_point(digests + w * dig, dig, conf->bits);
+            steps[w]++;
+            if (next & dp_mask)
+            {
+                if (steps[w] < max_len)
+                {
+                    cur[w] = next;
+                    continue;
+                }
+                worker->abandoned++;
+            }
+            else
+            {
+                struct rho_entry *entry = rho_insert(state, next, start[w], steps[w]);
+                if (entry && entry->start != start[w])
+                {
+                    worker->merges++;
+                    if (rho_locate(conf, start[w], steps[w], entry->start, entry->len, pair))
+                    {
+                        while (!channel_try_push(state->hits, pair) && !interrupted) sched_yield();
+                    }
+                    else worker->robin_hoods++;
+                }
+            }
+
+            // Start a fresh walk in place of the finished one
+            start[w] = cur[w] = prng_next(&worker->rng) & point_mask;
+            steps[w] = 0;
+        }
+    }
+    free(msgs);
+    free(digests);
+    __atomic_store_n(&worker->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Print a collision
+static void rho_print(const struct rho_conf *conf, const uint64_t *pair, char *hashbuf)
+{
+    const size_t len = (conf->bits + 7) / 8, dig = conf->algo->dig_size;
+    uint8_t msg[MAX_BLOCK_SIZE], digest[2][MAX_BLOCK_SIZE];
+    for (size_t idx = 0; idx < 2; idx++)
+    {
+        rho_message(pair[idx], msg, len);
+        conf->algo->hash_raw(msg, len, conf->rounds, digest[idx]);
+        printf(idx? "%s => " : "%s - ", to_hex(msg, len, hashbuf));
+    }
+    // Digests which only agree in their leading bits are both shown
+    if (conf->bits == 8 * dig) printf("%s\n", to_hex(digest[0], dig, hashbuf));
+    else
+    {
+        printf("%s ", to_hex(digest[0], dig, hashbuf));
+        printf("%s\n", to_hex(digest[1], dig, hashbuf));
+    }
+}
+
+// Search for collisions
+void run_rho(const struct rho_conf *conf)
+{
+    struct rho_state state = { conf };
+    state.hits = channel_new(1024, 2 * sizeof(uint64_t));
+    signal(SIGINT, on_interrupt);
+
+    // Finding k collisions takes about sqrt(2k * 2^bits) steps; leave plenty of room
+    // for the distinguished points those steps reach, and for the walks in flight
+    double expect = sqrt(2.0 * conf->collisions * ldexp(1.0, conf->bits)) * ldexp(1.0, -(int) conf->dp_bits);
+    uint64_t slots = 1024;
+    while (slots < RHO_MAX_TABLE && slots < 4 * expect + 4 * conf->nthreads * RHO_WALKS) slots *= 2;
+    state.table       = calloc(slots, sizeof(struct rho_entry));
+    state.table_mask  = slots - 1;
+    state.table_limit = slots / 4 * 3;
+
+    // Give every worker its own non-overlapping PRNG stream
+    struct prng rng;
+    prng_seed(&rng, conf->seed);
+    struct rho_worker *workers = calloc(conf->nthreads, sizeof(struct rho_worker));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        workers[idx].state = &state;
+        workers[idx].rng   = rng;
+        prng_jump(&rng);
+        pthread_create(&workers[idx].tid, NULL, rho_worker_main, &workers[idx]);
+    }
+
+    // Act as the single writer: print each new collision, and report progress.
+    // Walks often merge into a path found before, so repeats are skipped
+    uint64_t pair[2], *found = malloc(2 * sizeof(uint64_t) * conf->collisions);
+    uint64_t collisions = 0, last_steps = 0;
+    char *hashbuf = malloc(2*MAX_BLOCK_SIZE + 1);
+    double begin = now_seconds(), last = begin;
+    while (1)
+    {
+        size_t finished = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++)
+            finished += __atomic_load_n(&workers[idx].done, __ATOMIC_ACQUIRE);
+
+        bool idle = true;
+        while (channel_try_pop(state.hits, pair))
+        {
+            idle = false;
+            bool repeat = false;
+            for (uint64_t idx = 0; idx < collisions && !repeat; idx++)
+                repeat = found[2*idx] == pair[0] && found[2*idx + 1] == pair[1];
+            if (repeat || collisions == conf->collisions) continue;
+            found[2*collisions]     = pair[0];
+            found[2*collisions + 1] = pair[1];
+            collisions++;
+            rho_print(conf, pair, hashbuf);
+            if (collisions == conf->collisions) __atomic_store_n(&state.stop, 1, __ATOMIC_RELAXED);
+        }
+        if (!idle) fflush(stdout);
+        if (finished == conf->nthreads) break;
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            uint64_t steps = 0;
+            for (size_t idx = 0; idx < conf->nthreads; idx++)
+                steps += __atomic_load_n(&workers[idx].steps, __ATOMIC_RELAXED);
+            log_line(stderr, "%llu steps (%.3e/s), %llu distinguished points, %llu collisions",
+                     (unsigned long long) steps, (steps - last_steps) / (now - last),
+                     (unsigned long long) __atomic_load_n(&state.stored, __ATOMIC_RELAXED),
+                     (unsigned long long) collisions);
+            last_steps = steps;
+            last = now;
+        }
+        if (idle) sleep_ms(1);
+    }
+
+    // Summarise the search
+    uint64_t steps = 0, merges = 0, robin_hoods = 0, abandoned = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_join(workers[idx].tid, NULL);
+        steps       += workers[idx].steps;
+        merges      += workers[idx].merges;
+        robin_hoods += workers[idx].robin_hoods;
+        abandoned   += workers[idx].abandoned;
+    }
+    double elapsed = now_seconds() - begin;
+    printf("Steps: %llu (2^%.3f) in %.3fs; expected 2^%.3f for the first collision\n",
+           (unsigned long long) steps, steps? log2((double) steps) : 0.0, elapsed,
+           0.5 * (conf->bits + log2(M_PI / 2)));
+    printf("Distinguished points: %llu stored, 1 in 2^%u points\n",
+           (unsigned long long) state.stored, conf->dp_bits);
+    printf("Merges: %llu, of which %llu began on the other walk; %llu walks abandoned\n",
+           (unsigned long long) merges, (unsigned long long) robin_hoods, (unsigned long long) abandoned);
+    printf("Collisions: %llu\n", (unsigned long long) collisions);
+    if (state.stored >= state.table_limit) puts("The table of distinguished points filled up");
+    fflush(stdout);
+
+    free(workers);
+    free(found);
+    free(hashbuf);
+    free(state.table);
+    channel_free(state.hits);
+}
@@ -0,0 +1,54 @@
+// Multithreaded generic collision search with Pollard's rho and
+// distinguished points
+
+#ifndef __RHO
+#define __RHO
+
+#include <stdint.h>
+#include "algo.h"
+
+// How many walks each worker steps side by side through the batch engine
+#define RHO_WALKS 64
+
+// Configuration of a rho search
+struct rho_conf
+{
+    const struct hash_algo *algo;   // Algorithm being attacked
+    size_t rounds;                  // How many rounds of the algorithm to run
+    uint32_t bits;                  // How many leading bits of the digest must collide
+    uint32_t dp_bits;               // Points with this many low zero bits are distinguished
+    uint64_t collisions;            // Stop after finding this many distinct collisions
+    size_t nthreads;                // How many worker threads to run
+    uint64_t seed;                  // Seed for the workers' PRNG streams
+};
+
+// Pick how many low zero bits make a point distinguished. Every worker has
+// RHO_WALKS walks in flight, and the work spent on walks which are unfinished
+// when the search stops is wasted, so walks are kept well short of the
+// roughly 2^(bits/2) steps needed for a collision
+static inline uint32_t rho_dp_bits(uint32_t bits, size_t nthreads)
+{
+    int walks = 0;
+    while (((size_t) 1 << walks) < nthreads * RHO_WALKS) walks++;
+    int dp = (int) bits / 2 - walks - 3;
+    return dp > 0? dp : 0;
+}
+
+// Search for pairs of messages whose digests agree in their leading bits,
+// with the parallel collision search of van Oorschot and Wiener. A point is a
+// bits-wide integer x; the message for x is its big-endian encoding in
+// (bits + 7) / 8 bytes, and the next point is the leading bits of its digest.
+// Workers start walks at random points and follow them until they reach a
+// distinguished point, which is stored in a lock-free table shared by every
+// worker along with the walk's start and length. When a walk reaches a point
+// already in the table, both walks are retraced from their starts to the
+// point where they merge, giving a collision. Only the distinguished points
+// are stored, so memory use is small even when bits is large.
+// Each collision is printed to stdout as it is found, and progress is reported
+// to stderr. The search stops after conf->collisions collisions, or when
+// interrupted with ^C.
+// Params:
+// - conf: Configuration of the search
+void run_rho(const struct rho_conf *conf);
+
+#endif // __RHO
@@ -4,11 +4,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <immintrin.h>
 #include "util.h"
+#include "sha2.h"
 
 // SHA-256:
-#define SHA256_BLOCK_SIZE  64 // 512 bits => 64 bytes for every block
-#define SHA256_DIGEST_SIZE 32 // 256 bits => 32 bytes for the digest
 static inline uint32_t ch32(uint32_t x, uint32_t y, uint32_t z)  { return (x & y) ^ ((~x) & z);        }
 static inline uint32_t maj32(uint32_t x, uint32_t y, uint32_t z) { return (x & y) ^ (x & z) ^ (y & z); }
 static inline uint32_t Sigma0_256(uint32_t x) { return rotr32(x, 2)  ^ rotr32(x, 13) ^ rotr32(x, 22);  }
@@ -26,80 +26,376 @@ static inline uint32_t Sigma1_512(uint32_t x) { return rotr64(x, 14) ^ rotr64(x,
 static inline uint32_t sigma0_512(uint32_t x) { return rotr64(x, 1)  ^ rotr64(x, 8)  ^ (x >> 7);       }
 static inline uint32_t sigma1_512(uint32_t x) { return rotr64(x, 19) ^ rotr64(x, 61) ^ (x >> 6);       }
 
-// Fetch the next block from the input; if padding is required, this will be
-// emplaced in a local buffer. Repeat calls to next_block with the same pointer
-// will return sequential blocks until the final block has been consumed; at
-// this point, NULL will be returned. If a different pointer is passed, then
-// the first block of the new pointer is fetched, and the process restarts
-static uint8_t *next_block(const uint8_t *ptr, size_t len)
+// SHA-256 constants used by every block
+static const uint32_t K256[64] = 
 {
-    static const uint8_t *lastptr = NULL;       // Start of the first block of the input we are chunking
-    static size_t idx = 0;                      // Index of the next block
-    static uint8_t local[SHA256_BLOCK_SIZE];    // Local buffer for storing partial blocks
-    static int needs_empty_block = 0;           // Whether or not we have a case where the final block is empty
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
 
-    // New input
-    if (lastptr != ptr)
+// Run the SHA-256 compression function over a single block M, updating H
+// in-place. This is only ever inlined with a constant number of rounds, so
+// that the loop is fully unrolled and only as much of the schedule as is used
+// is made
+static inline __attribute__((always_inline)) void sha256_scalar_body(uint32_t *H, const uint8_t *M, const int rounds)
+{
+    // Registers
+    uint32_t a = H[0], b = H[1], c = H[2], d = H[3],
+             e = H[4], f = H[5], g = H[6], h = H[7];
+    // Message schedule
+    uint32_t W[64];
+
+    // Transform this block
+    #pragma GCC unroll 64
+    for (int t = 0; t < rounds; t++)
+    {
+        // Set up the message schedule for this round
+        if (t < 16) { W[t] = b2h32(((const uint32_t *)M)[t]); }
+        else { W[t] = sigma1_256(W[t-2]) + W[t-7] + sigma0_256(W[t-15]) + W[t-16]; }
+        
+        // Transform the block
+        uint32_t T1 = h + Sigma1_256(e) + ch32(e, f, g) + K256[t] + W[t];
+        uint32_t T2 = Sigma0_256(a) + maj32(a, b, c);
+        h = g; g = f; f = e; e = d + T1;
+        d = c; c = b; b = a; a = T1 + T2;          
+    }
+ 
+    // Update H
+    H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+    H[4] += e; H[5] += f; H[6] += g; H[7] += h; 
+}
+
+// Run the SHA-256 compression function over a single block M using the SHA
+// extensions, updating H in-place. sha256rnds2 always performs two rounds, so
+// an odd final round is done with scalar code. As above, this is only ever
+// inlined with a constant number of rounds
+__attribute__((target("sha,sse4.1")))
+static inline __attribute__((always_inline)) void sha256_shani_body(uint32_t *H, const uint8_t *M, const int rounds)
+{
+    // Byte order mask for loading big-endian words
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // Message schedule, four words per vector; only as much as is needed is computed
+    __m128i W[16];
+    for (int i = 0; i < 4; i++)
+    {
+        W[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(M + 16*i)), bswap);
+    }
+    #pragma GCC unroll 16
+    for (int i = 4; 4*i < rounds; i++)
+    {
+        W[i] = _mm_sha256msg2_epu32(
+                _mm_add_epi32(_mm_sha256msg1_epu32(W[i-4], W[i-3]), _mm_alignr_epi8(W[i-1], W[i-2], 4)),
+                W[i-1]);
+    }
+
+    // Registers, packed as the instructions expect: ABEF and CDGH
+    __m128i abef = _mm_set_epi32(H[0], H[1], H[4], H[5]),
+            cdgh = _mm_set_epi32(H[2], H[3], H[6], H[7]);
+
+    // Transform the block, two rounds at a time
+    int t;
+    #pragma GCC unroll 32
+    for (t = 0; t + 2 <= rounds; t += 2)
+    {
+        __m128i wk = _mm_add_epi32(W[t/4], _mm_loadu_si128((const __m128i *)(K256 + 4*(t/4))));
+        if (t % 4) wk = _mm_shuffle_epi32(wk, 0x0e);
+        __m128i next = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+        cdgh = abef;
+        abef = next;
+    }
+
+    // Unpack the registers
+    uint32_t r_abef[4], r_cdgh[4], w[4];
+    _mm_storeu_si128((__m128i *) r_abef, abef);
+    _mm_storeu_si128((__m128i *) r_cdgh, cdgh);
+    uint32_t a = r_abef[3], b = r_abef[2], c = r_cdgh[3], d = r_cdgh[2],
+             e = r_abef[1], f = r_abef[0], g = r_cdgh[1], h = r_cdgh[0];
+
+    // Odd number of rounds; perform the last one here
+    if (t < rounds)
+    {
+        _mm_storeu_si128((__m128i *) w, W[t/4]);
+        uint32_t T1 = h + Sigma1_256(e) + ch32(e, f, g) + K256[t] + w[t % 4];
+        uint32_t T2 = Sigma0_256(a) + maj32(a, b, c);
+        h = g; g = f; f = e; e = d + T1;
+        d = c; c = b; b = a; a = T1 + T2;
+    }
+
+    // Update H
+    H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+    H[4] += e; H[5] += f; H[6] += g; H[7] += h; 
+}
+
+// Every supported round count
+#define SHA256_ROUNDS(X) \
+    X(0)  X(1)  X(2)  X(3)  X(4)  X(5)  X(6)  X(7)  X(8)  X(9)  X(10) X(11) X(12) \
+    X(13) X(14) X(15) X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25) \
+    X(26) X(27) X(28) X(29) X(30) X(31) X(32) X(33) X(34) X(35) X(36) X(37) X(38) \
+    X(39) X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) X(48) X(49) X(50) X(51) \
+    X(52) X(53) X(54) X(55) X(56) X(57) X(58) X(59) X(60) X(61) X(62) X(63) X(64)
+
+// One compression function of each kind specialised for each round count
+#define COMPRESS_N(n) \
+    static void sha256_compress_scalar_##n(uint32_t *H, const uint8_t *M) { sha256_scalar_body(H, M, n); } \
+    __attribute__((target("sha,sse4.1"))) \
+    static void sha256_compress_shani_##n(uint32_t *H, const uint8_t *M) { sha256_shani_body(H, M, n); }
+SHA256_ROUNDS(COMPRESS_N)
+#undef COMPRESS_N
+
+// The specialised compression functions, indexed by round count
+#define SCALAR_ENTRY(n) sha256_compress_scalar_##n,
+#define SHANI_ENTRY(n)  sha256_compress_shani_##n,
+static void (*const sha256_compress_scalar[65])(uint32_t *, const uint8_t *) = { SHA256_ROUNDS(SCALAR_ENTRY) };
+static void (*const sha256_compress_shani[65])(uint32_t *, const uint8_t *)  = { SHA256_ROUNDS(SHANI_ENTRY) };
+#undef SCALAR_ENTRY
+#undef SHANI_ENTRY
+
+// Supported compression functions, fastest first
+static const struct
+{
+    const char *name;
+    void (*const *compress)(uint32_t *, const uint8_t *); // Indexed by round count
+} backends[] =
+{
+    { "sha-ni", sha256_compress_shani  },
+    { "scalar", sha256_compress_scalar },
+};
+
+// Pick the fastest compression function supported by this CPU; this is only done once
+static int pick_backend()
+{
+    static int picked = -1;
+    if (picked < 0)
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1")) picked = 0;
+        else                                                                   picked = 1;
+    }
+    return picked;
+}
+
+// Name the compression function used by the SHA-256 context API on this CPU
+const char *sha256_backend()
+{
+    return backends[pick_backend()].name;
+}
+
+// Run the first block of two messages through the SHA-256 compression
+// function in lockstep, checking the difference in the registers after every round
+size_t sha256_pair_check(const uint8_t *M1, const uint8_t *M2, size_t rounds,
+                         const uint8_t *expect, const uint8_t *mask)
+{
+    // Ensure rounds is valid
+    if (rounds > 64) rounds = 64;
+
+    // Registers, starting from the IV
+    uint32_t S1[8] = 
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 
+    };
+    uint32_t S2[8];
+    memcpy(S2, S1, sizeof(S1));
+    // Message schedules
+    uint32_t W1[64], W2[64];
+
+    for (int t = 0; t < rounds; t++)
+    {
+        // Set up the message schedules for this round
+        if (t < 16)
+        {
+            W1[t] = b2h32(((const uint32_t *)M1)[t]);
+            W2[t] = b2h32(((const uint32_t *)M2)[t]);
+        }
+        else
+        {
+            W1[t] = sigma1_256(W1[t-2]) + W1[t-7] + sigma0_256(W1[t-15]) + W1[t-16];
+            W2[t] = sigma1_256(W2[t-2]) + W2[t-7] + sigma0_256(W2[t-15]) + W2[t-16];
+        }
+
+        // Transform both states
+        uint32_t *S = S1, *W = W1;
+        for (int pair = 0; pair < 2; pair++, S = S2, W = W2)
+        {
+            uint32_t T1 = S[7] + Sigma1_256(S[4]) + ch32(S[4], S[5], S[6]) + K256[t] + W[t];
+            uint32_t T2 = Sigma0_256(S[0]) + maj32(S[0], S[1], S[2]);
+            S[7] = S[6]; S[6] = S[5]; S[5] = S[4]; S[4] = S[3] + T1;
+            S[3] = S[2]; S[2] = S[1]; S[1] = S[0]; S[0] = T1 + T2;
+        }
+
+        // Give up as soon as the pair leaves the characteristic
+        uint32_t miss = 0;
+        for (int k = 0; k < 8; k++)
+        {
+            uint32_t e = b2h32(((const uint32_t *)(expect + 32*t))[k]),
+                     m = b2h32(((const uint32_t *)(mask + 32*t))[k]);
+            miss |= ((S1[k] ^ S2[k]) ^ e) & m;
+        }
+        if (miss) return t;
+    }
+    return rounds;
+}
+
+// Hash the input once for every round count from 1 to rounds, sharing the
+// work done on the first block between all of them
+void sha256_hash_sweep(const uint8_t *ptr, size_t len, size_t rounds, uint8_t *states, uint8_t *digests)
+{
+    // Ensure rounds is valid
+    if (rounds > 64) rounds = 64;
+
+    // Lay out the padded tail: whatever is left past the last full block, the
+    // 1-bit, zeroes, then the length as a big-endian 64-bit int
+    size_t full = len - len % SHA256_BLOCK_SIZE;
+    uint8_t tail[2*SHA256_BLOCK_SIZE] = { 0 };
+    memcpy(tail, ptr + full, len - full);
+    tail[len - full] = 0x80;
+    size_t tail_len = len - full + 1 + 8 <= SHA256_BLOCK_SIZE? SHA256_BLOCK_SIZE : 2*SHA256_BLOCK_SIZE;
+    uint64_t bits = h2b64(len * 8);
+    memcpy(tail + tail_len - 8, &bits, sizeof(bits));
+    size_t nblocks = (full + tail_len) / SHA256_BLOCK_SIZE;
+    #define BLOCK(i) ((i) * SHA256_BLOCK_SIZE < full? ptr + (i) * SHA256_BLOCK_SIZE \
+                                                    : tail + (i) * SHA256_BLOCK_SIZE - full)
+
+    // Run the first block once, recording the registers after every round
+    static const uint32_t IV[8] = 
     {
-        lastptr = ptr;
-        idx = 0;
-        needs_empty_block = 0;
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 
+    };
+    uint32_t trace[64][8];
+    uint32_t S[8], W[64];
+    memcpy(S, IV, sizeof(IV));
+    const uint8_t *M = BLOCK(0);
+    for (int t = 0; t < rounds; t++)
+    {
+        if (t < 16) { W[t] = b2h32(((const uint32_t *)M)[t]); }
+        else { W[t] = sigma1_256(W[t-2]) + W[t-7] + sigma0_256(W[t-15]) + W[t-16]; }
+        uint32_t T1 = S[7] + Sigma1_256(S[4]) + ch32(S[4], S[5], S[6]) + K256[t] + W[t];
+        uint32_t T2 = Sigma0_256(S[0]) + maj32(S[0], S[1], S[2]);
+        S[7] = S[6]; S[6] = S[5]; S[5] = S[4]; S[4] = S[3] + T1;
+        S[3] = S[2]; S[2] = S[1]; S[1] = S[0]; S[0] = T1 + T2;
+        memcpy(trace[t], S, sizeof(S));
     }
+    if (states)
+    {
+        for (size_t t = 0; t < rounds; t++)
+        for (int k = 0; k < 8; k++)
+        {
+            uint32_t word = h2b32(trace[t][k]);
+            memcpy(states + 32*t + 4*k, &word, sizeof(word));
+        }
+    }
+    if (!digests) return;
 
-    // Edge case: we hit case #3 last time, and need to produce a block with all zeroes + length
-    if (needs_empty_block)
+    // Stopping after round t gives the chaining value for t rounds; the
+    // remaining blocks depend on it, so have to be run for each t separately
+    void (*const *compress)(uint32_t *, const uint8_t *) = backends[pick_backend()].compress;
+    for (size_t t = 0; t < rounds; t++)
     {
-        memset(local, 0, SHA256_BLOCK_SIZE - 8);
-        *(uint64_t *)(local + SHA256_BLOCK_SIZE - 8) = h2b64(len * 8);
-        idx += SHA256_BLOCK_SIZE;
-        needs_empty_block = 0;
-        return local;
+        uint32_t H[8];
+        for (int k = 0; k < 8; k++) H[k] = IV[k] + trace[t][k];
+        for (size_t i = 1; i < nblocks; i++) compress[t + 1](H, BLOCK(i));
+        for (int k = 0; k < 8; k++)
+        {
+            uint32_t word = h2b32(H[k]);
+            memcpy(digests + SHA256_DIGEST_SIZE * t + 4*k, &word, sizeof(word));
+        }
     }
+    #undef BLOCK
+}
+
+// Initialise a SHA-256 context, ready to accept input
+void sha256_init(struct sha256_ctx *ctx, size_t rounds)
+{
+    // Ensure rounds is valid
+    if (rounds > 64) rounds = 64;
+
+    // Set up the IV
+    static const uint32_t IV[8] = 
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 
+    };
+    memcpy(ctx->H, IV, sizeof(IV));
+    ctx->compress = backends[pick_backend()].compress[rounds];
+    ctx->rounds   = rounds;
+    ctx->len      = 0;
+    ctx->buf_len  = 0;
+}
+
+// Feed len bytes of ptr into the context
+void sha256_update(struct sha256_ctx *ctx, const uint8_t *ptr, size_t len)
+{
+    ctx->len += len;
 
-    // Marker that we have exhausted all the data in ptr
-    if (idx > len)
+    // Top up a partial block left over from the previous call
+    if (ctx->buf_len)
     {
-        lastptr = NULL;
-        return NULL;
+        size_t take = SHA256_BLOCK_SIZE - ctx->buf_len;
+        if (take > len) take = len;
+        memcpy(ctx->buf + ctx->buf_len, ptr, take);
+        ctx->buf_len += take;
+        ptr += take;
+        len -= take;
+        if (ctx->buf_len < SHA256_BLOCK_SIZE) return;
+        ctx->compress(ctx->H, ctx->buf);
+        ctx->buf_len = 0;
     }
-    
-    // Pointer to the next [potentially partial] block
-    const uint8_t *block = ptr + idx;
-    // How many bytes of actual data remain
-    size_t partial = len - idx;
-
-    // Do we have a full block to send
-    if (partial >= SHA256_BLOCK_SIZE)
-    {
-        // Mark that this block has been consumed
-        idx += SHA256_BLOCK_SIZE;
-        return block;
+
+    // Full blocks are compressed straight out of the caller's buffer
+    for ( ; len >= SHA256_BLOCK_SIZE; ptr += SHA256_BLOCK_SIZE, len -= SHA256_BLOCK_SIZE)
+    {
+        ctx->compress(ctx->H, ptr);
     }
-    // A partial block which can fit at least 1 byte padding + length
-    else if (partial <= SHA256_BLOCK_SIZE - 1 - 8)
-    {
-        // Copy the partial block into local, then append bits as per the standard
-        memcpy(local, block, partial);
-        local[partial++] = 0x80;
-        while (partial < SHA256_BLOCK_SIZE - 8) { local[partial++] = 0x00; }
-        // Append the length (in bits) as a big-endian 64-bit int
-        *(uint64_t *)(local + partial) = h2b64(len * 8);
-        idx += SHA256_BLOCK_SIZE;
-        return local;
+
+    // Stash whatever remains for next time
+    memcpy(ctx->buf, ptr, len);
+    ctx->buf_len = len;
+}
+
+// Pad the input, and write the raw 32-byte digest into digest
+void sha256_final(struct sha256_ctx *ctx, uint8_t *digest)
+{
+    size_t partial = ctx->buf_len;
+    ctx->buf[partial++] = 0x80;
+
+    // Not enough room for the length; pad out this block and use another
+    if (partial > SHA256_BLOCK_SIZE - 8)
+    {
+        while (partial < SHA256_BLOCK_SIZE) { ctx->buf[partial++] = 0x00; }
+        ctx->compress(ctx->H, ctx->buf);
+        partial = 0;
     }
-    // A partial block which requires the creation of an extra block afterwards (56 to 63 bytes)
-    else
-    {
-        // Copy the partial block into local, then append bits as per the standard
-        memcpy(local, block, partial);
-        local[partial++] = 0x80;
-        while (partial < SHA256_BLOCK_SIZE) { local[partial++] = 0x00; }
-        idx += SHA256_BLOCK_SIZE;
-        needs_empty_block = 1;
-        return local;
+    while (partial < SHA256_BLOCK_SIZE - 8) { ctx->buf[partial++] = 0x00; }
+    // Append the length (in bits) as a big-endian 64-bit int
+    uint64_t bits = h2b64(ctx->len * 8);
+    memcpy(ctx->buf + partial, &bits, sizeof(bits));
+    ctx->compress(ctx->H, ctx->buf);
+
+    // Digest is the big-endian encoding of H
+    for (int i = 0; i < 8; i++)
+    {
+        uint32_t word = h2b32(ctx->H[i]);
+        memcpy(digest + 4*i, &word, sizeof(word));
     }
 }
 
+// Compute the raw SHA256 digest of the input into digest
+void sha256_hash_raw(const uint8_t *ptr, size_t len, size_t rounds, uint8_t *digest)
+{
+    struct sha256_ctx ctx;
+    sha256_init(&ctx, rounds);
+    sha256_update(&ctx, ptr, len);
+    sha256_final(&ctx, digest);
+}
+
 // Compute the SHA256 hash of the input.
 // Params:
 // - ptr: A non-null pointer to an array of data to hash
@@ -115,63 +411,12 @@ char *sha256_hash(const uint8_t *ptr, size_t len, size_t rounds, char *buf)
     // No pointer
     if (!ptr) { return NULL; }
 
-    // Ensure rounds is valid
-    if (rounds > 64) rounds = 64;  
-
-    // Set up the IV
-    uint32_t H[8] = 
-    {
-        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
-        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 
-    };
-
-    // Set up the constants
-    uint32_t K[64] = 
-    {
-        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
-    };
-
-    // Current block
-    uint8_t *M = NULL;
-    int block = 0;
-    while ((M = next_block(ptr, len)) != NULL)
-    {
-        // Registers
-        uint32_t a = H[0], b = H[1], c = H[2], d = H[3],
-                 e = H[4], f = H[5], g = H[6], h = H[7];
-        // Message schedule
-        uint32_t W[64];
-
-        // Transform this block
-        for (int t = 0; t < rounds; t++)
-        {
-            // Set up the message schedule for this round
-            if (t < 16) { W[t] = b2h32(((uint32_t *)M)[t]); }
-            else { W[t] = sigma1_256(W[t-2]) + W[t-7] + sigma0_256(W[t-15]) + W[t-16]; }
-            
-            // Transform the block
-            uint32_t T1 = h + Sigma1_256(e) + ch32(e, f, g) + K[t] + W[t];
-            uint32_t T2 = Sigma0_256(a) + maj32(a, b, c);
-            h = g; g = f; f = e; e = d + T1;
-            d = c; c = b; b = a; a = T1 + T2;          
-        }
- 
-        // Update H
-        H[0] += a; H[1] += b; H[2] += c; H[3] += d;
-        H[4] += e; H[5] += f; H[6] += g; H[7] += h; 
-    }
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    sha256_hash_raw(ptr, len, rounds, digest);
 
-    // Copy H into buf, using a local buffer if necessary
-    char local[2*SHA256_DIGEST_SIZE+1];
+    // Copy the digest into buf, using a local buffer if necessary
+    static char local[2*SHA256_DIGEST_SIZE+1];
     if (!buf) { buf = local; }
-    sprintf(buf, "%08x%08x%08x%08x%08x%08x%08x%08x",
-            H[0], H[1], H[2], H[3], H[4], H[5], H[6], H[7]);
+    for (int i = 0; i < SHA256_DIGEST_SIZE; i++) sprintf(buf + 2*i, "%02x", digest[i]);
     return buf;
 }
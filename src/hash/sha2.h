@@ -1,8 +1,116 @@
 // Headers for SHA-2 algorithms, specifically:
 // - SHA-256
 
+#ifndef __SHA2
+#define __SHA2
+
 #include <stdio.h>  // size_t
-#include <stdint.h> // uint8_t
+#include <stdint.h> // uint8_t, uint32_t, uint64_t
+
+#define SHA256_BLOCK_SIZE  64 // 512 bits => 64 bytes for every block
+#define SHA256_DIGEST_SIZE 32 // 256 bits => 32 bytes for the digest
+
+// Streaming state for SHA-256. Every context is independent, so separate
+// contexts may be used concurrently from separate threads
+struct sha256_ctx
+{
+    uint32_t H[8];                  // Chaining value
+    uint8_t buf[SHA256_BLOCK_SIZE]; // Partial block carried between updates
+    size_t buf_len;                 // How many bytes of buf are in use
+    uint64_t len;                   // Total length of the input so far, in bytes
+    size_t rounds;                  // How many rounds of the hash function to run
+    void (*compress)(uint32_t *, const uint8_t *); // Compression function picked for this CPU and round count
+};
+
+// Initialise a SHA-256 context, ready to accept input.
+// Params:
+// - ctx: The context to initialise
+// - rounds: How many rounds of the hash function to run
+void sha256_init(struct sha256_ctx *ctx, size_t rounds);
+
+// Feed more input into a SHA-256 context. Input may be supplied in chunks of
+// any size; full blocks are read directly from ptr without being copied.
+// Params:
+// - ctx: An initialised context
+// - ptr: A pointer to len bytes of data to hash
+// - len: The length of ptr in bytes
+void sha256_update(struct sha256_ctx *ctx, const uint8_t *ptr, size_t len);
+
+// Pad the input and produce the final digest. The context must be
+// reinitialised with sha256_init before it is used again.
+// Params:
+// - ctx: An initialised context
+// - digest: A block of at least 32 bytes in which to store the raw digest
+void sha256_final(struct sha256_ctx *ctx, uint8_t *digest);
+
+// Compute the raw SHA256 digest of the input.
+// Params:
+// - ptr: A non-null pointer to an array of data to hash
+// - len: The length of ptr in bytes
+// - rounds: How many rounds of the hash function to run
+// - digest: A block of at least 32 bytes in which to store the digest
+void sha256_hash_raw(const uint8_t *ptr, size_t len, size_t rounds, uint8_t *digest);
+
+// Compute the raw SHA256 digests of many messages at once. Messages are hashed
+// eight at a time in the lanes of an AVX2 register where the CPU supports it,
+// falling back to hashing them one at a time if not.
+// Params:
+// - msgs: A pointer to n messages of len bytes each, stored back-to-back
+// - n: How many messages to hash
+// - len: The length of every message in bytes
+// - rounds: How many rounds of the hash function to run
+// - out: A block of at least 32*n bytes in which to store the digests
+void sha256_hash_many(const uint8_t *msgs, size_t n, size_t len, size_t rounds, uint8_t *out);
+
+// As sha256_hash_many, for messages which all begin with the same blocks.
+// The shared blocks are compressed only once, and the chaining value after
+// them is used as the starting point for every message.
+// Params:
+// - msgs: A pointer to n messages of len bytes each, stored back-to-back
+// - n: How many messages to hash
+// - len: The length of every message in bytes
+// - shared: How many whole blocks at the start of every message are the same;
+//           at most len/64
+// - rounds: How many rounds of the hash function to run
+// - out: A block of at least 32*n bytes in which to store the digests
+void sha256_hash_many_shared(const uint8_t *msgs, size_t n, size_t len, size_t shared,
+                             size_t rounds, uint8_t *out);
+
+// Name the compression function used for single messages on this CPU, e.g. "sha-ni"
+const char *sha256_backend();
+
+// Name the kernel used by sha256_hash_many on this CPU, e.g. "avx2"
+const char *sha256_many_backend();
+
+// Run the first block of two messages through the SHA-256 compression
+// function in lockstep, checking the XOR difference of the registers
+// (a, ..., h) after every round against a differential characteristic. The
+// pair is abandoned as soon as any masked bit differs from the characteristic.
+// Params:
+// - M1, M2: The first block of each message; 64 bytes each
+// - rounds: How many rounds of the hash function to run
+// - expect: The expected difference in (a, ..., h) after each round, as
+//           big-endian words; 32*rounds bytes
+// - mask: Which bits of expect must be matched after each round; 32*rounds bytes
+// Returns: How many rounds the pair followed the characteristic for; this is
+//          rounds if the pair conforms to the whole characteristic
+size_t sha256_pair_check(const uint8_t *M1, const uint8_t *M2, size_t rounds,
+                         const uint8_t *expect, const uint8_t *mask);
+
+// Compute the raw SHA-256 digest of the input for every round count from 1 to
+// rounds in a single pass. The first block is only run through the
+// compression function once, with the registers recorded after every round;
+// when the padded input is a single block (at most 55 bytes), this is all of
+// the work. Later blocks are chained from each round count separately.
+// Params:
+// - ptr: A non-null pointer to an array of data to hash
+// - len: The length of ptr in bytes
+// - rounds: The largest number of rounds to run
+// - states: If non-null, receives the registers (a, ..., h) after each round
+//           of the first block, laid out as for sha256_pair_check; 32*rounds bytes
+// - digests: If non-null, receives the digest for 1, 2, ..., rounds rounds;
+//            32*rounds bytes
+void sha256_hash_sweep(const uint8_t *ptr, size_t len, size_t rounds, uint8_t *states, uint8_t *digests);
 
 // Compute the SHA256 hash of the input.
 // Params:
@@ -15,3 +123,5 @@
 //          this will be a local buffer, otherwise buf will be returned. If
 //          ptr is NULL, then NULL is returned
 char *sha256_hash(const uint8_t *ptr, size_t len, size_t rounds, char *buf);
+
+#endif // __SHA2
@@ -0,0 +1,204 @@
+// Multi-buffer implementation of SHA-256.
+// SHA-256 works on 32-bit words, so an AVX2 register holds one word of state
+// for eight independent messages. Each lane of the vectors runs its own copy
+// of the compression function over the matching block of its message.
+
+#include <string.h>
+#include <stdint.h>
+#include "util.h"
+#include "sha2.h"
+
+// Number of messages processed together by one call of a kernel
+#define LANES 8
+
+// A vector holding one word from each of LANES messages
+typedef uint32_t lanes_t __attribute__((vector_size(4*LANES)));
+
+// Constants used by every block
+static const uint32_t K256[64] = 
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// SHA-256 internals, across every lane
+#define ROTR(x, n)      (((x) >> (n)) | ((x) << (32 - (n))))
+#define CH(x, y, z)     (((x) & (y)) ^ ((~(x)) & (z)))
+#define MAJ(x, y, z)    (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define SIGMA0(x)       (ROTR(x, 2)  ^ ROTR(x, 13) ^ ROTR(x, 22))
+#define SIGMA1(x)       (ROTR(x, 6)  ^ ROTR(x, 11) ^ ROTR(x, 25))
+#define sigma0(x)       (ROTR(x, 7)  ^ ROTR(x, 18) ^ ((x) >> 3))
+#define sigma1(x)       (ROTR(x, 17) ^ ROTR(x, 19) ^ ((x) >> 10))
+
+// Hash up to LANES messages of length len, writing n raw digests to out. The
+// first skip bytes of every message are the same, and have already been
+// compressed into the chaining value mid
+static inline __attribute__((always_inline))
+void hash_lanes(const uint32_t *mid, size_t skip, const uint8_t *msgs, size_t n, size_t len,
+                size_t rounds, uint8_t *out)
+{
+    // Start from the shared chaining value
+    lanes_t H[8];
+    for (int k = 0; k < 8; k++)
+    {
+        uint32_t tmp[LANES];
+        for (int lane = 0; lane < LANES; lane++) tmp[lane] = mid[k];
+        memcpy(&H[k], tmp, sizeof(tmp));
+    }
+
+    // Every message has the same length, so the same number of blocks. The
+    // final one or two blocks are padded into tail, one per lane
+    size_t padded = ((len + 1 + 8 + SHA256_BLOCK_SIZE - 1) / SHA256_BLOCK_SIZE) * SHA256_BLOCK_SIZE;
+    size_t full   = len / SHA256_BLOCK_SIZE * SHA256_BLOCK_SIZE;
+    uint8_t tail[LANES][2*SHA256_BLOCK_SIZE];
+    uint64_t bits = h2b64(len * 8);
+    for (size_t lane = 0; lane < LANES; lane++)
+    {
+        memset(tail[lane], 0, sizeof(tail[lane]));
+        if (lane < n) memcpy(tail[lane], msgs + lane * len + full, len - full);
+        tail[lane][len - full] = 0x80;
+        memcpy(tail[lane] + padded - full - 8, &bits, 8);
+    }
+
+    for (size_t block = skip; block < padded; block += SHA256_BLOCK_SIZE)
+    {
+        // Locate this block in each lane
+        const uint8_t *M[LANES];
+        for (size_t lane = 0; lane < LANES; lane++)
+        {
+            if (block < full && lane < n) M[lane] = msgs + lane * len + block;
+            else if (block < full)        M[lane] = tail[lane];
+            else                          M[lane] = tail[lane] + block - full;
+        }
+
+        // Registers
+        lanes_t a = H[0], b = H[1], c = H[2], d = H[3],
+                e = H[4], f = H[5], g = H[6], h = H[7];
+        // Message schedule
+        lanes_t W[64];
+
+        // Transform this block
+        for (int t = 0; t < rounds; t++)
+        {
+            // Set up the message schedule for this round
+            if (t < 16)
+            {
+                uint32_t tmp[LANES];
+                for (int lane = 0; lane < LANES; lane++) tmp[lane] = b2h32(((const uint32_t *) M[lane])[t]);
+                memcpy(&W[t], tmp, sizeof(tmp));
+            }
+            else { W[t] = sigma1(W[t-2]) + W[t-7] + sigma0(W[t-15]) + W[t-16]; }
+
+            // Transform the block
+            lanes_t T1 = h + SIGMA1(e) + CH(e, f, g) + K256[t] + W[t];
+            lanes_t T2 = SIGMA0(a) + MAJ(a, b, c);
+            h = g; g = f; f = e; e = d + T1;
+            d = c; c = b; b = a; a = T1 + T2;
+        }
+
+        // Update H
+        H[0] += a; H[1] += b; H[2] += c; H[3] += d;
+        H[4] += e; H[5] += f; H[6] += g; H[7] += h;
+    }
+
+    // Transpose H back into one big-endian digest per message
+    uint32_t tmp[8][LANES];
+    memcpy(tmp, H, sizeof(tmp));
+    for (size_t lane = 0; lane < n; lane++)
+    for (int k = 0; k < 8; k++)
+    {
+        uint32_t word = h2b32(tmp[k][lane]);
+        memcpy(out + lane * SHA256_DIGEST_SIZE + 4*k, &word, 4);
+    }
+}
+
+// Kernels for each supported instruction set
+__attribute__((target("avx2")))
+static void hash_lanes_avx2(const uint32_t *mid, size_t skip, const uint8_t *msgs, size_t n, size_t len,
+                            size_t rounds, uint8_t *out)
+{
+    hash_lanes(mid, skip, msgs, n, len, rounds, out);
+}
+
+// Fallback for CPUs without AVX2; simply hashes one message at a time
+static void hash_lanes_single(const uint32_t *mid, size_t skip, const uint8_t *msgs, size_t n, size_t len,
+                              size_t rounds, uint8_t *out)
+{
+    for (size_t idx = 0; idx < n; idx++)
+    {
+        struct sha256_ctx ctx;
+        sha256_init(&ctx, rounds);
+        memcpy(ctx.H, mid, sizeof(ctx.H));
+        ctx.len = skip;
+        sha256_update(&ctx, msgs + idx * len + skip, len - skip);
+        sha256_final(&ctx, out + idx * SHA256_DIGEST_SIZE);
+    }
+}
+
+// Signature shared by every kernel
+typedef void (*kernel_t)(const uint32_t *, size_t, const uint8_t *, size_t, size_t, size_t, uint8_t *);
+
+// Supported kernels, widest first
+static const struct
+{
+    const char *name;
+    kernel_t kernel;
+} backends[] =
+{
+    { "avx2",   hash_lanes_avx2   },
+    { "single", hash_lanes_single },
+};
+
+// Pick the widest kernel supported by this CPU; this is only done once
+static int pick_backend()
+{
+    static int picked = -1;
+    if (picked < 0)
+    {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) picked = 0;
+        else                                picked = 1;
+    }
+    return picked;
+}
+
+// Name the kernel which sha256_hash_many uses on this CPU
+const char *sha256_many_backend()
+{
+    return backends[pick_backend()].name;
+}
+
+// Compute the raw SHA-256 digests of n messages of length len, whose first
+// shared blocks are the same
+void sha256_hash_many_shared(const uint8_t *msgs, size_t n, size_t len, size_t shared,
+                             size_t rounds, uint8_t *out)
+{
+    // Ensure rounds is valid
+    if (rounds > 64) rounds = 64;
+    if (!n) return;
+
+    // Compress the shared blocks once, for every message
+    struct sha256_ctx ctx;
+    size_t skip = shared * SHA256_BLOCK_SIZE;
+    sha256_init(&ctx, rounds);
+    sha256_update(&ctx, msgs, skip);
+
+    kernel_t kernel = backends[pick_backend()].kernel;
+    for (size_t idx = 0; idx < n; idx += LANES)
+    {
+        size_t count = n - idx < LANES? n - idx : LANES;
+        kernel(ctx.H, skip, msgs + idx * len, count, len, rounds, out + idx * SHA256_DIGEST_SIZE);
+    }
+}
+
+// Compute the raw SHA-256 digests of n messages of length len
+void sha256_hash_many(const uint8_t *msgs, size_t n, size_t len, size_t rounds, uint8_t *out)
+{
+    sha256_hash_many_shared(msgs, n, len, 0, rounds, out);
+}
@@ -0,0 +1,322 @@
+// Multithreaded statistics over the digests of randomly sampled inputs
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "util.h"
+#include "algo.h"
+#include "prng.h"
+#include "channel.h"
+#include "threads.h"
+#include "stats.h"
+
+// Most length buckets that results are split into
+#define MAX_BUCKETS 16
+
+// A digest kept for collision counting, along with a fingerprint of its input
+// so that two samples of the same input are not mistaken for a collision
+struct tracked
+{
+    uint64_t key;                   // First (up to) 8 bytes of the digest
+    uint64_t input;                 // FNV-1a hash of the input and its length
+};
+
+// State owned by a single worker
+struct stats_worker
+{
+    pthread_t tid;
+    const struct stats_conf *conf;
+    uint64_t *issued;               // Shared count of samples handed out so far
+    struct prng rng;                // This worker's PRNG stream
+    uint64_t *counts;               // Occurrences of each byte value at each digest position, per bucket
+    uint64_t *bucket_samples;       // How many samples fell into each bucket
+    struct tracked *tracked;        // Digests kept for collision counting
+    size_t ntracked, cap;           // How many entries of tracked are in use, and allocated
+    uint64_t done_samples;          // How many samples have been hashed; read by the main thread
+    int done;                       // Set once the worker has finished
+    char pad[CACHE_LINE];
+};
+
+// Number of length buckets, and which bucket an input length falls into
+static size_t num_buckets(const struct stats_conf *conf)
+{
+    uint64_t mod = (uint64_t) conf->max - conf->min + 1;
+    return mod < MAX_BUCKETS? mod : MAX_BUCKETS;
+}
+
+static inline size_t bucket_of(const struct stats_conf *conf, size_t nb, uint32_t len)
+{
+    uint64_t mod = (uint64_t) conf->max - conf->min + 1;
+    return (size_t)((uint64_t)(len - conf->min) * nb / mod);
+}
+
+// Fingerprint an input for telling apart collisions from repeated inputs
+static inline uint64_t fingerprint(const uint8_t *ptr, size_t len)
+{
+    uint64_t h = 0xcbf29ce484222325ULL ^ len;
+    for (size_t idx = 0; idx < len; idx++) h = (h ^ ptr[idx]) * 0x100000001b3ULL;
+    return h;
+}
+
+// Comparators for qsort
+static int cmp_len(const void *x, const void *y)
+{
+    uint32_t a = *(const uint32_t *) x, b = *(const uint32_t *) y;
+    return (a > b) - (a < b);
+}
+
+static int cmp_tracked(const void *x, const void *y)
+{
+    const struct tracked *a = x, *b = y;
+    if (a->key != b->key) return (a->key > b->key) - (a->key < b->key);
+    return (a->input > b->input) - (a->input < b->input);
+}
+
+// Worker thread; hashes batches of random inputs until the samples run out
+static void *stats_worker_main(void *arg)
+{
+    struct stats_worker *worker = (struct stats_worker *) arg;
+    const struct stats_conf *conf = worker->conf;
+    const struct hash_algo *algo = conf->algo;
+    const size_t dig = algo->dig_size, keylen = dig < 8? dig : 8, nb = num_buckets(conf);
+    const uint32_t mod = conf->max - conf->min + 1;
+
+    // Keep a batch of maximum length samples to a reasonable size
+    size_t batch = BATCH_SIZE;
+    if ((uint64_t) batch * conf->max > (1 << 24)) batch = conf->max < (1 << 24)? (1 << 24) / conf->max : 1;
+    uint32_t *lens   = calloc(batch, sizeof(uint32_t));
+    uint8_t *buf     = calloc((size_t) batch * conf->max + 1, 1);
+    uint8_t *digests = calloc(batch, dig);
+
+    while (1)
+    {
+        // Claim the next batch of samples
+        uint64_t start = __atomic_fetch_add(worker->issued, batch, __ATOMIC_RELAXED);
+        if (start >= conf->samples) break;
+        size_t count = conf->samples - start < batch? conf->samples - start : batch;
+
+        // Pick lengths in [min, max], sorted so that equal lengths are hashed together
+        for (size_t idx = 0; idx < count; idx++) lens[idx] = conf->min + prng_below(&worker->rng, mod);
+        qsort(lens, count, sizeof(uint32_t), cmp_len);
+        size_t total = 0;
+        for (size_t idx = 0; idx < count; idx++) total += lens[idx];
+        prng_fill(&worker->rng, buf, total);
+
+        uint8_t *sent = buf;
+        for (size_t idx = 0, end; idx < count; idx = end)
+        {
+            for (end = idx; end < count && lens[end] == lens[idx]; end++) ;
+            hash_many(algo, sent, end - idx, lens[idx], conf->rounds, digests + idx * dig);
+            sent += (end - idx) * lens[idx];
+        }
+
+        // Tally every digest into its length bucket
+        bool track = start < STATS_MAX_TRACKED;
+        if (track && worker->ntracked + count > worker->cap)
+        {
+            worker->cap = 2 * (worker->ntracked + count);
+            worker->tracked = realloc(worker->tracked, worker->cap * sizeof(struct tracked));
+        }
+        sent = buf;
+        for (size_t idx = 0; idx < count; idx++)
+        {
+            const uint8_t *digest = digests + idx * dig;
+            size_t bucket = bucket_of(conf, nb, lens[idx]);
+            uint64_t *counts = worker->counts + bucket * dig * 256;
+            for (size_t pos = 0; pos < dig; pos++) counts[pos * 256 + digest[pos]]++;
+            worker->bucket_samples[bucket]++;
+
+            if (track)
+            {
+                struct tracked *entry = &worker->tracked[worker->ntracked++];
+                entry->key = 0;
+                memcpy(&entry->key, digest, keylen);
+                entry->input = fingerprint(sent, lens[idx]);
+            }
+            sent += lens[idx];
+        }
+        __atomic_fetch_add(&worker->done_samples, count, __ATOMIC_RELAXED);
+    }
+    free(lens);
+    free(buf);
+    free(digests);
+    __atomic_store_n(&worker->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// Chi-square statistic of 256 byte value counts against a uniform distribution
+static double chi_square(const uint64_t *counts, uint64_t total)
+{
+    if (!total) return 0.0;
+    double expected = total / 256.0, chi = 0.0;
+    for (int v = 0; v < 256; v++) chi += (counts[v] - expected) * (counts[v] - expected) / expected;
+    return chi;
+}
+
+// Bias of bit k (0 is the most significant) of a byte position, from its value counts
+static double bit_bias(const uint64_t *counts, uint64_t total, int k)
+{
+    if (!total) return 0.0;
+    uint64_t ones = 0;
+    for (int v = 0; v < 256; v++) if (v & (0x80 >> k)) ones += counts[v];
+    return (double) ones / total - 0.5;
+}
+
+// Count the pairs of distinct inputs which share a digest key
+static uint64_t count_collisions(struct tracked *all, size_t len, uint64_t *repeats)
+{
+    uint64_t pairs = 0;
+    *repeats = 0;
+    qsort(all, len, sizeof(struct tracked), cmp_tracked);
+    for (size_t idx = 0, end; idx < len; idx = end)
+    {
+        // Every pair in a run of equal keys collides, except for pairs of the same input
+        for (end = idx; end < len && all[end].key == all[idx].key; end++) ;
+        uint64_t run = end - idx, same = 0;
+        for (size_t i = idx, j; i < end; i = j)
+        {
+            for (j = i; j < end && all[j].input == all[i].input; j++) ;
+            same += (uint64_t)(j - i) * (j - i - 1) / 2;
+            *repeats += j - i - 1;
+        }
+        pairs += run * (run - 1) / 2 - same;
+    }
+    return pairs;
+}
+
+// Sample inputs and print statistics about their digests
+void run_stats(const struct stats_conf *conf)
+{
+    const struct hash_algo *algo = conf->algo;
+    const size_t dig = algo->dig_size, nb = num_buckets(conf);
+    const size_t ncounts = nb * dig * 256;
+
+    // Give every worker its own non-overlapping PRNG stream
+    struct prng rng;
+    prng_seed(&rng, conf->seed);
+    uint64_t issued = 0;
+    struct stats_worker *workers = calloc(conf->nthreads, sizeof(struct stats_worker));
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        workers[idx].conf           = conf;
+        workers[idx].issued         = &issued;
+        workers[idx].rng            = rng;
+        workers[idx].counts         = calloc(ncounts, sizeof(uint64_t));
+        workers[idx].bucket_samples = calloc(nb, sizeof(uint64_t));
+        prng_jump(&rng);
+        pthread_create(&workers[idx].tid, NULL, stats_worker_main, &workers[idx]);
+    }
+
+    // Report progress until everybody has finished
+    uint64_t last_samples = 0;
+    double last = now_seconds();
+    while (1)
+    {
+        size_t finished = 0;
+        for (size_t idx = 0; idx < conf->nthreads; idx++)
+            finished += __atomic_load_n(&workers[idx].done, __ATOMIC_ACQUIRE);
+        if (finished == conf->nthreads) break;
+
+        double now = now_seconds();
+        if (now - last >= STATUS_INTERVAL)
+        {
+            uint64_t samples = 0;
+            for (size_t idx = 0; idx < conf->nthreads; idx++)
+                samples += __atomic_load_n(&workers[idx].done_samples, __ATOMIC_RELAXED);
+            log_line(stderr, "%llu/%llu samples (%.3e/s)", (unsigned long long) samples,
+                     (unsigned long long) conf->samples, (samples - last_samples) / (now - last));
+            last_samples = samples;
+            last = now;
+        }
+        sleep_ms(10);
+    }
+
+    // Merge every worker's counters into the first
+    uint64_t *counts = workers[0].counts, *bucket_samples = workers[0].bucket_samples;
+    size_t ntracked = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        pthread_join(workers[idx].tid, NULL);
+        ntracked += workers[idx].ntracked;
+    }
+    struct tracked *tracked = malloc((ntracked + 1) * sizeof(struct tracked));
+    ntracked = 0;
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        if (idx)
+        {
+            for (size_t i = 0; i < ncounts; i++) counts[i] += workers[idx].counts[i];
+            for (size_t b = 0; b < nb; b++) bucket_samples[b] += workers[idx].bucket_samples[b];
+        }
+        memcpy(tracked + ntracked, workers[idx].tracked, workers[idx].ntracked * sizeof(struct tracked));
+        ntracked += workers[idx].ntracked;
+    }
+
+    // Fold the buckets together for the overall results
+    uint64_t samples = 0, *overall = calloc(dig * 256, sizeof(uint64_t)), all_bytes[256] = { 0 };
+    for (size_t b = 0; b < nb; b++)
+    {
+        samples += bucket_samples[b];
+        for (size_t i = 0; i < dig * 256; i++) overall[i] += counts[b * dig * 256 + i];
+    }
+    for (size_t i = 0; i < dig * 256; i++) all_bytes[i % 256] += overall[i];
+
+    printf("Samples: %llu\n", (unsigned long long) samples);
+    printf("Per byte: chi-square (255 dof), then bias of each bit from 1/2, most significant first\n");
+    double max_bias = 0.0;
+    size_t max_bit = 0;
+    for (size_t pos = 0; pos < dig; pos++)
+    {
+        printf("  Byte %2zu: %8.2f ", pos, chi_square(overall + pos * 256, samples));
+        for (int k = 0; k < 8; k++)
+        {
+            double bias = bit_bias(overall + pos * 256, samples, k);
+            printf(" %+.5f", bias);
+            if (fabs(bias) > max_bias) { max_bias = fabs(bias); max_bit = 8 * pos + k; }
+        }
+        printf("\n");
+    }
+    printf("All bytes: chi-square %.2f (255 dof)\n", chi_square(all_bytes, samples * dig));
+    printf("Max |bias|: %.5f at bit %zu (expected deviation %.5f)\n",
+           max_bias, max_bit, samples? 0.5 / sqrt((double) samples) : 0.0);
+
+    // Collisions; for random digests, each pair collides with probability 2^-bits
+    uint64_t repeats, pairs = count_collisions(tracked, ntracked, &repeats);
+    const size_t bits = 8 * (dig < 8? dig : 8);
+    printf("Collisions on %zu bits: %llu among %zu samples (expected %.3f), %llu repeated inputs\n",
+           bits, (unsigned long long) pairs, ntracked,
+           ldexp((double) ntracked * (ntracked - 1) / 2, -(int) bits), (unsigned long long) repeats);
+
+    // Results for each bucket of input lengths
+    const uint64_t mod = (uint64_t) conf->max - conf->min + 1;
+    for (size_t b = 0; b < nb; b++)
+    {
+        // Lengths in bucket b are those with floor((len - min) * nb / mod) == b
+        uint64_t lo = conf->min + (b * mod + nb - 1) / nb, hi = conf->min + ((b + 1) * mod + nb - 1) / nb - 1;
+        uint64_t n = bucket_samples[b], bytes[256] = { 0 };
+        double worst = 0.0;
+        for (size_t pos = 0; pos < dig; pos++)
+        {
+            const uint64_t *c = counts + (b * dig + pos) * 256;
+            for (int v = 0; v < 256; v++) bytes[v] += c[v];
+            for (int k = 0; k < 8; k++) if (fabs(bit_bias(c, n, k)) > worst) worst = fabs(bit_bias(c, n, k));
+        }
+        printf("Lengths %llu-%llu: %llu samples, max |bias| %.5f, chi-square %.2f\n",
+               (unsigned long long) lo, (unsigned long long) hi, (unsigned long long) n,
+               worst, chi_square(bytes, n * dig));
+    }
+    fflush(stdout);
+
+    for (size_t idx = 0; idx < conf->nthreads; idx++)
+    {
+        free(workers[idx].counts);
+        free(workers[idx].bucket_samples);
+        free(workers[idx].tracked);
+    }
+    free(workers);
+    free(tracked);
+    free(overall);
+}
@@ -0,0 +1,38 @@
+// Multithreaded statistics over the digests of randomly sampled inputs
+
+#ifndef __STATS
+#define __STATS
+
+#include <stdint.h>
+#include "algo.h"
+
+// Only the first this many samples are kept for counting digest collisions
+#define STATS_MAX_TRACKED (1 << 26)
+
+// Configuration of a statistics run
+struct stats_conf
+{
+    const struct hash_algo *algo;   // Algorithm being sampled
+    size_t rounds;                  // How many rounds of the algorithm to run
+    uint32_t min, max;              // Range of input lengths, in bytes
+    uint64_t samples;               // How many inputs to sample
+    size_t nthreads;                // How many worker threads to run
+    uint64_t seed;                  // Seed for the workers' PRNG streams
+};
+
+// Sample random inputs with lengths uniform in [min, max], and collect
+// statistics about their digests without printing them. Every worker keeps
+// its own counters of each byte value at each digest position, split into
+// buckets by input length, and these are merged once every sample is taken.
+// The following are printed to stdout:
+// - The bias of every output bit away from 1/2
+// - A chi-square statistic of the byte values at each digest position
+// - How many pairs of distinct inputs collide on the first (up to) 64 bits of
+//   the digest, among the first STATS_MAX_TRACKED samples
+// - The largest bias and chi-square statistic within each length bucket
+// Progress is reported to stderr.
+// Params:
+// - conf: Configuration of the run
+void run_stats(const struct stats_conf *conf);
+
+#endif // __STATS
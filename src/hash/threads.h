@@ -0,0 +1,35 @@
+// Helpers for the multithreaded modes of the hasher
+
+#ifndef __THREADS
+#define __THREADS
+
+#include <time.h>       // clock_gettime, nanosleep
+#include <unistd.h>     // sysconf
+#include <pthread.h>    // pthread_create, pthread_join
+
+// How often the multithreaded modes report their progress, in seconds
+#define STATUS_INTERVAL 5.0
+
+// Number of online CPU cores; used when the user asks for -j 0
+static inline size_t num_cores()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0? (size_t) n : 1;
+}
+
+// Seconds since some fixed point, for measuring rates
+static inline double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Sleep for the given number of milliseconds
+static inline void sleep_ms(long ms)
+{
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+#endif // __THREADS
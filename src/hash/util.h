@@ -1,5 +1,11 @@
 // General utilities
 
+#ifndef __UTIL
+#define __UTIL
+
+#include <stdio.h>      // FILE, fprintf
+#include <stdarg.h>     // va_list
+#include <time.h>       // time, localtime, strftime
 #include <stdint.h>     // uint32_t, uint64_t
 #include <byteswap.h>   // __bswap_32, __bswap_64
 
@@ -75,3 +81,28 @@ static inline uint64_t b2h64(uint64_t x)
 {
     return h2b64(x);
 }
+
+// Log a timestamped line to stream
+static inline void log_line(FILE *stream, const char *fmt, ...)
+{
+    // Print timestamp
+    {
+        char buf[8+1];
+        time_t t;
+        time(&t);
+        struct tm *info = localtime(&t);
+        strftime(buf, 9, "%H:%M:%S", info);
+        fprintf(stream, "[%s] ", buf);
+    }
+    // Print fmt
+    {
+        va_list args;
+        va_start(args, fmt);
+        vfprintf(stream, fmt, args);
+        fputc('\n', stream);
+        va_end(args);
+    }
+    fflush(stream);
+}
+
+#endif // __UTIL
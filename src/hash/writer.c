@@ -0,0 +1,80 @@
+// Dedicated output thread
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "channel.h"
+#include "threads.h"
+#include "writer.h"
+
+// How many buffers may be waiting at once
+#define WRITER_QUEUE 16
+
+// A buffer handed over by a producer; a NULL buf tells the writer to stop
+struct writer_item
+{
+    void *buf;
+    size_t len;
+};
+
+// Writer thread; writes buffers in the order they were queued
+static void *writer_main(void *arg)
+{
+    struct writer *w = (struct writer *) arg;
+    struct writer_item item;
+    while (1)
+    {
+        if (!channel_try_pop(w->queue, &item))
+        {
+            sleep_ms(1);
+            continue;
+        }
+        if (!item.buf) break;
+
+        // write may be partial, e.g. into a pipe
+        const char *pos = item.buf;
+        size_t left = item.len;
+        while (left)
+        {
+            ssize_t done = write(w->fd, pos, left);
+            if (done < 0 && errno == EINTR) continue;
+            if (done < 0)
+            {
+                perror("write");
+                break;
+            }
+            pos  += done;
+            left -= done;
+        }
+        free(item.buf);
+    }
+    return NULL;
+}
+
+// Start a writer thread
+struct writer *writer_start(int fd)
+{
+    struct writer *w = (struct writer *) calloc(1, sizeof(struct writer));
+    w->fd    = fd;
+    w->queue = channel_new(WRITER_QUEUE, sizeof(struct writer_item));
+    pthread_create(&w->tid, NULL, writer_main, w);
+    return w;
+}
+
+// Queue a buffer to be written
+void writer_put(struct writer *w, void *buf, size_t len)
+{
+    struct writer_item item = { buf, len };
+    while (!channel_try_push(w->queue, &item)) sleep_ms(1);
+}
+
+// Write out everything that is queued, then stop
+void writer_finish(struct writer *w)
+{
+    writer_put(w, NULL, 0);
+    pthread_join(w->tid, NULL);
+    channel_free(w->queue);
+    free(w);
+}
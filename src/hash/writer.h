@@ -0,0 +1,41 @@
+// Dedicated output thread. Producers hand over whole buffers, which are
+// written out with large write(2) calls while the producers carry on hashing.
+
+#ifndef __WRITER
+#define __WRITER
+
+#include <stddef.h>
+#include <pthread.h>
+#include "channel.h"
+
+// How large a buffer producers should fill before handing it over
+#define WRITER_BUFFER (1 << 20)
+
+// State of a writer thread
+struct writer
+{
+    pthread_t tid;
+    int fd;                         // Where everything is written
+    struct channel *queue;          // Buffers waiting to be written, in order
+};
+
+// Start a writer thread.
+// Params:
+// - fd: The file descriptor to write everything to
+// Returns: The new writer
+struct writer *writer_start(int fd);
+
+// Queue a buffer to be written, blocking while the queue is full. The buffer
+// must have been allocated with malloc; the writer frees it once written.
+// Params:
+// - w: A running writer
+// - buf: The data to write
+// - len: The length of buf in bytes
+void writer_put(struct writer *w, void *buf, size_t len);
+
+// Write out everything that is queued, then stop and free the writer.
+// Params:
+// - w: A running writer
+void writer_finish(struct writer *w);
+
+#endif // __WRITER
@@ -69,6 +69,34 @@ static inline void print_gene(gene_t gene, char *annotation)
             get_fitness(gene), annotation);
 }
 
+// Where the most probable trail of the fittest gene seen is written, if
+// anywhere, and the fitness of that gene
+const char *trail_fname = NULL;
+static double trail_fitness = 0.0f;
+
+// Write the most probable zero trail of gene to trail_fname, if it is the
+// fittest seen so far. Each round is one line, as the hasher's -c flag reads
+static void save_trail(gene_t gene, size_t rounds, float pthresh)
+{
+    if (!trail_fname || !gene.zero_trails || get_fitness(gene) <= trail_fitness) return;
+    trail_fitness = get_fitness(gene);
+
+    uint8_t trail[4*16];
+    propagate(gene.diff, rounds, pthresh, trail);
+    FILE *file = fopen(trail_fname, "w");
+    if (!file)
+    {
+        log(stdout, "Error: Unable to open file %s", trail_fname);
+        return;
+    }
+    for (size_t t = 0; t < rounds; t++)
+    {
+        fprintf(file, "0x%02x%02x%02x%02x\n", trail[4*t], trail[4*t+1], trail[4*t+2], trail[4*t+3]);
+    }
+    fclose(file);
+    print_gene(gene, (char *)" - Trail saved");
+}
+
 // Choose a random gene from the pool, weighted by their fitness
 static size_t dice(mt19937& gen, gene_t *pool, size_t len)
 {
@@ -239,7 +267,12 @@ void show_usage()
         "               Defaults to 0.05 (5%)\n"
         "  -l file      Reads each line from the file as an input\n"
         "               difference of the form 0x......\\n, and outputs\n"
-        "               their fitnesses to stdout.");
+        "               their fitnesses to stdout.\n"
+        "  -c file      Writes the most probable trail ending in a\n"
+        "               zero difference of the fittest gene seen to\n"
+        "               the file, as the register differences after\n"
+        "               each round in the form 0x........\\n. This\n"
+        "               is the characteristic read by hasher -c.");
 }
 
 // Entry point
@@ -269,7 +302,7 @@ int main(int argc, char **argv)
 
     // Read args
     int option = -1;
-    while ((option = getopt(argc, argv, "hidfn:p:r:s:m:l:")) != -1) switch (option)
+    while ((option = getopt(argc, argv, "hidfn:p:r:s:m:l:c:")) != -1) switch (option)
     {
         case 'd':
             dry_run = true;
@@ -318,6 +351,10 @@ int main(int argc, char **argv)
             ASSERT(file_list != NULL, log(stdout, "Error: Unable to open file %s", optarg));
             break;
 
+        case 'c':
+            trail_fname = optarg;
+            break;
+
         default:
             ASSERT(0);
     }
@@ -337,6 +374,7 @@ int main(int argc, char **argv)
     log(stdout, "Pool size: %zu", pool_size);
     log(stdout, "Immigration rate: %f", immigration_rate);
     log(stdout, "Reading log file: %s", file_list? "true" : "false");
+    log(stdout, "Trail file: %s", trail_fname? trail_fname : "none");
     puts("");
 
     // Load memos
@@ -367,11 +405,11 @@ int main(int argc, char **argv)
             for (int idx = 0; idx < 8; idx++)
             {
                 if      ('0' <= line[2*idx] && line[2*idx] <= '9') { gene.diff[idx] = line[2*idx] - '0'; }
-                else if ('a' <= line[2*idx] && line[2*idx] <= 'f') { gene.diff[idx] = line[2*idx] - 'a'; }
+                else if ('a' <= line[2*idx] && line[2*idx] <= 'f') { gene.diff[idx] = line[2*idx] - 'a' + 10; }
                 else ASSERT(false, log(stdout, "Error: Malformed line at index %d \"%s\"", 2*idx+2, line));
                 gene.diff[idx] <<= 4;
                 if      ('0' <= line[2*idx+1] && line[2*idx+1] <= '9') { gene.diff[idx] |= line[2*idx+1] - '0'; }
-                else if ('a' <= line[2*idx+1] && line[2*idx+1] <= 'f') { gene.diff[idx] |= line[2*idx+1] - 'a'; }
+                else if ('a' <= line[2*idx+1] && line[2*idx+1] <= 'f') { gene.diff[idx] |= line[2*idx+1] - 'a' + 10; }
                 else ASSERT(false, log(stdout, "Error: Malformed line at index %d \"%s\"", 2*idx+3, line));
             }
             tuple<size_t,size_t,double> result = propagate(gene.diff, rounds, pthresh); 
@@ -379,6 +417,7 @@ int main(int argc, char **argv)
             gene.total_trails = get<1>(result);
             gene.prob         = get<2>(result);
             print_gene(gene, (char *)" - Immigration");
+            save_trail(gene, rounds, pthresh);
         }
         free(buf);
         fclose(file_list);
@@ -407,7 +446,9 @@ int main(int argc, char **argv)
     // If we're only after random data
     if (random_only) while (1)
     {
-        print_gene(get_next_gene(), (char *)" - Immigration");
+        gene_t gene = get_next_gene();
+        print_gene(gene, (char *)" - Immigration");
+        save_trail(gene, rounds, pthresh);
     }
 
     // Gather enough differentials to use for genetic algorithms
@@ -511,6 +552,7 @@ int main(int argc, char **argv)
             if (get_fitness(pool[i]) > get_fitness(*best)) best = &pool[i];
         }
         print_gene(*best, (char *)" - Best");
+        save_trail(*best, rounds, pthresh);
  
         // Everything has been repopulated.
         log(stdout, "Population %zu bred.", pool_num);
@@ -219,8 +219,11 @@ static vector<pair<uint8_t,int8_t>> propagate_maj(const uint8_t d_x, const uint8
     return result;
 }
 
-// Take a differential, and propagate through to round n.
-static tuple<size_t,size_t,double> propagate(const uint8_t *msg_diff, const size_t n, const float pthresh)
+// Take a differential, and propagate through to round n. If best_trail is
+// given, the register differences after each round of the most probable trail
+// ending in a zero difference are copied to it, 4*n bytes in all
+static tuple<size_t,size_t,double> propagate(const uint8_t *msg_diff, const size_t n, const float pthresh,
+                                             uint8_t *best_trail = NULL)
 {
     // Must have a message diff
     if (!msg_diff)
@@ -245,6 +248,7 @@ static tuple<size_t,size_t,double> propagate(const uint8_t *msg_diff, const size
     size_t total_trails = 0,
            zero_trails  = 0;
     double prob         = 0.0f;
+    ssize_t best_l2prob = 0;
 
     // Backtracking value
 #define STACK_ELEM pair<struct prop_state, vector<pair<uint8_t,int8_t>>>
@@ -421,6 +425,11 @@ static tuple<size_t,size_t,double> propagate(const uint8_t *msg_diff, const size
         {
             total_trails++;
             zero_trails += !state.diff;
+            if (best_trail && !state.diff && (zero_trails == 1 || state.l2prob > best_l2prob))
+            {
+                memcpy(best_trail, state.trail, 4*n);
+                best_l2prob = state.l2prob;
+            }
             // prob       = log2f(pow(2, l2prob) + pow(2, state.l2prob)); // += state.l2prob;
             prob        += pow(2, state.l2prob);
         }